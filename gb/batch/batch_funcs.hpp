@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+
+#include "../macros.hpp"
+#include "../structs.hpp"
+
+#include "../gameboy.hpp"
+
+#include "batch_struct.hpp"
+
+namespace gb {
+    bool batch_pop(batch_queue_t* q, size_t* job) {
+        std::lock_guard<std::mutex> lock(q->mutex);
+
+        if (q->jobs.empty()) return false;
+
+        *job = q->jobs.back();
+
+        q->jobs.pop_back();
+
+        return true;
+    }
+
+    bool batch_steal(batch_queue_t* q, size_t* job) {
+        std::lock_guard<std::mutex> lock(q->mutex);
+
+        if (q->jobs.empty()) return false;
+
+        *job = q->jobs.front();
+
+        q->jobs.pop_front();
+
+        return true;
+    }
+
+    void batch_run_job(batch_job_t* job, gameboy_t* gb) {
+        init(gb);
+
+        job->loaded = insert_cartridge(gb, job->path.c_str());
+
+        if (job->loaded) {
+            // Test ROMs don't care for the logo scroll
+            skip_boot(gb);
+
+            job->cycles = run_fast(gb, job->budget);
+
+            cpu_flags_sync(&gb->cpu);
+
+            std::memcpy(job->r, gb->cpu.r, sizeof(job->r));
+
+            job->pc = gb->cpu.pc;
+            job->sp = gb->cpu.sp;
+        }
+
+        destroy(gb);
+    }
+
+    void batch_worker(std::vector<batch_job_t>* jobs, std::vector<batch_queue_t>* queues, size_t self) {
+        size_t count = queues->size();
+        size_t job;
+
+        // One instance per worker, reused for every job it runs
+        gameboy_t* gb = new gameboy_t;
+
+        while (true) {
+            bool found = batch_pop(&(*queues)[self], &job);
+
+            // Out of work, go through everyone else's queue.
+            // Jobs never spawn jobs, so once every queue is
+            // empty there's nothing left to do
+            for (size_t i = 1; !found && (i < count); i++)
+                found = batch_steal(&(*queues)[(self + i) % count], &job);
+
+            if (!found) break;
+
+            batch_run_job(&(*jobs)[job], gb);
+        }
+
+        delete gb;
+    }
+
+    // Run every job across `threads` workers (0 = one per core),
+    // results are written back into `jobs`
+    void batch_run(std::vector<batch_job_t>* jobs, unsigned threads = 0) {
+        if (!threads) threads = std::thread::hardware_concurrency();
+        if (!threads) threads = 1;
+
+        std::vector<batch_queue_t> queues(threads);
+
+        // Deal jobs round-robin, stealing evens out the rest
+        for (size_t i = 0; i < jobs->size(); i++)
+            queues[i % threads].jobs.push_back(i);
+
+        std::vector<std::thread> workers;
+
+        for (unsigned i = 0; i < threads; i++)
+            workers.emplace_back(batch_worker, jobs, &queues, (size_t)i);
+
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <mutex>
+
+#include "../macros.hpp"
+#include "../structs.hpp"
+
+namespace gb {
+    struct batch_job_t {
+        std::string path;
+
+        // How long to run this ROM for, in half cycles
+        uint64_t budget;
+
+        // Filled in by whichever worker ran the job
+        bool loaded;
+        uint64_t cycles;
+        uint8_t r[8];
+        uint16_t pc;
+        uint16_t sp;
+    };
+
+    // Each worker owns a queue of job indices, it pops from the
+    // back of its own and steals from the front of everyone else's
+    struct batch_queue_t {
+        std::deque<size_t> jobs;
+        std::mutex mutex;
+    };
+}
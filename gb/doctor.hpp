@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+
+#include "macros.hpp"
+#include "structs.hpp"
+#include "log.hpp"
+#include "mapped_file.hpp"
+
+#include "gameboy.hpp"
+
+// Compares live CPU state against a reference log in Gameboy Doctor
+// format, one line per instruction, taken right before it runs:
+//
+//   A:01 F:B0 B:00 C:13 D:00 E:D8 H:01 L:4D SP:FFFE PC:0100 PCMEM:00,C3,13,02
+//
+// Lines have a fixed layout, so they're checked against a template
+// 8 bytes at a time and the 16 hex bytes are decoded from fixed
+// offsets, no scanning involved. The log is mapped, not read.
+//
+// As Gameboy Doctor expects, the instance starts from the post-boot
+// state and LY (ff44) reads 0x90.
+
+#define DOCTOR_LINE    73
+#define DOCTOR_WORDS   10   // Template words, covers the line and \r\n
+#define DOCTOR_CONTEXT 4    // Matching lines shown before a divergence
+
+namespace gb {
+    // Where each state byte's 2 hex digits are, in the order
+    // A F B C D E H L SP PC PCMEM[4]
+    constexpr uint8_t doctor_offsets[16] = {
+        2, 7, 12, 17, 22, 27, 32, 37,
+        43, 45,
+        51, 53,
+        62, 65, 68, 71
+    };
+
+    struct doctor_template_t {
+        uint64_t mask[DOCTOR_WORDS];
+        uint64_t text[DOCTOR_WORDS];
+    };
+
+    // Every non-hex character of the line, as masked 8 byte words
+    constexpr doctor_template_t doctor_template_generate() {
+        const char* line = "A:.. F:.. B:.. C:.. D:.. E:.. H:.. L:.. SP:.... PC:.... PCMEM:..,..,..,..";
+
+        doctor_template_t t = {};
+
+        for (int i = 0; i < DOCTOR_LINE; i++) {
+            if (line[i] == '.') continue;
+
+            t.mask[i >> 3] |= 0xffull << ((i & 7) * 8);
+            t.text[i >> 3] |= (uint64_t)(uint8_t)line[i] << ((i & 7) * 8);
+        }
+
+        return t;
+    }
+
+    constexpr doctor_template_t doctor_template = doctor_template_generate();
+
+    struct doctor_hex_t {
+        uint8_t v[256];     // 0x80 for anything that isn't a hex digit
+    };
+
+    constexpr doctor_hex_t doctor_hex_generate() {
+        doctor_hex_t t = {};
+
+        for (int i = 0; i < 256; i++) {
+            if ((i >= '0') && (i <= '9')) t.v[i] = i - '0';
+            else if ((i >= 'a') && (i <= 'f')) t.v[i] = i - 'a' + 10;
+            else if ((i >= 'A') && (i <= 'F')) t.v[i] = i - 'A' + 10;
+            else t.v[i] = 0x80;
+        }
+
+        return t;
+    }
+
+    constexpr doctor_hex_t doctor_hex = doctor_hex_generate();
+
+    // `p` must have DOCTOR_WORDS * 8 readable bytes
+    inline bool doctor_parse(const uint8_t* p, uint8_t* state) {
+        uint64_t diff = 0;
+
+        for (int i = 0; i < DOCTOR_WORDS; i++) {
+            uint64_t w;
+
+            std::memcpy(&w, p + i * 8, 8);
+
+            diff |= (w & doctor_template.mask[i]) ^ doctor_template.text[i];
+        }
+
+        uint8_t bad = 0;
+
+        for (int i = 0; i < 16; i++) {
+            uint8_t hi = doctor_hex.v[p[doctor_offsets[i]]];
+            uint8_t lo = doctor_hex.v[p[doctor_offsets[i] + 1]];
+
+            bad |= hi | lo;
+            state[i] = (hi << 4) | (lo & 0xf);
+        }
+
+        return !diff && !(bad & 0x80);
+    }
+
+    // Same layout as doctor_parse's output
+    inline void doctor_capture(gameboy_t* gb, uint8_t* state) {
+        cpu_t* cpu = &gb->cpu;
+
+        // The fast core leaves the next opcode fetched
+        uint16_t pc = (cpu->state == ST_FETCH) ? cpu->pc : cpu->pc - 1;
+
+        state[0] = cpu->r[7];
+        state[1] = cpu_flags(cpu);
+
+        std::memcpy(&state[2], cpu->r, 6);
+
+        state[8] = cpu->sp >> 8;
+        state[9] = cpu->sp & 0xff;
+        state[10] = pc >> 8;
+        state[11] = pc & 0xff;
+
+        for (int i = 0; i < 4; i++)
+            state[12 + i] = mem_read(&gb->map, pc + i);
+    }
+
+    void doctor_format(const uint8_t* s, char* out) {
+        std::snprintf(out, DOCTOR_LINE + 1,
+            "A:%02X F:%02X B:%02X C:%02X D:%02X E:%02X H:%02X L:%02X SP:%02X%02X PC:%02X%02X PCMEM:%02X,%02X,%02X,%02X",
+            s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7],
+            s[8], s[9], s[10], s[11], s[12], s[13], s[14], s[15]
+        );
+    }
+
+    uint8_t doctor_read(void* ctx, uint16_t addr) {
+        // LY, as if every frame sat at the start of VBlank
+        if (addr == 0xff44) return 0x90;
+
+        return mem_handler_read(ctx, addr);
+    }
+
+    // Runs `gb` on the fast core, one instruction per line of the
+    // log at `path`. Stops at the first line that doesn't match
+    // and prints it along with what led there to `out`.
+    // Returns whether the whole log matched
+    bool doctor_compare(gameboy_t* gb, const char* path, FILE* out) {
+        mapped_file_t file;
+
+        if (!mapped_file_open(&file, path))
+            return false;
+
+        mapped_file_sequential(&file);
+
+        skip_boot(gb);
+        sync(gb);
+
+        scheduler_cancel(&gb->sched, EV_CPU);
+
+        gb->map.read = doctor_read;
+
+        const uint8_t* p = file.data;
+        const uint8_t* end = file.data + file.size;
+
+        // Start offsets of the last few lines, for context
+        const uint8_t* recent[DOCTOR_CONTEXT] = {};
+
+        uint64_t line = 0;
+        bool ok = true;
+
+        while (p < end) {
+            // The tail of the file goes through a padded copy,
+            // everything else is parsed in place
+            uint8_t pad[DOCTOR_WORDS * 8] = {};
+            const uint8_t* src = p;
+
+            if ((size_t)(end - p) < sizeof(pad)) {
+                std::memcpy(pad, p, end - p);
+
+                src = pad;
+            }
+
+            uint8_t expected[16], actual[16];
+
+            bool parsed = doctor_parse(src, expected);
+
+            doctor_capture(gb, actual);
+
+            if (!parsed || std::memcmp(expected, actual, 16)) {
+                char text[DOCTOR_LINE + 1];
+
+                for (int i = 0; i < DOCTOR_CONTEXT; i++) {
+                    const uint8_t* r = recent[(line + i) % DOCTOR_CONTEXT];
+
+                    if (r) std::fprintf(out, "  %.*s\n", DOCTOR_LINE, (const char*)r);
+                }
+
+                doctor_format(actual, text);
+
+                if (parsed) {
+                    std::fprintf(out, "Diverged on line %llu\n", (unsigned long long)(line + 1));
+                } else {
+                    std::fprintf(out, "Line %llu isn't in Gameboy Doctor format\n", (unsigned long long)(line + 1));
+                }
+
+                std::fprintf(out, "- %.*s\n+ %s\n", DOCTOR_LINE, (const char*)src, text);
+
+                ok = false;
+
+                break;
+            }
+
+            recent[line % DOCTOR_CONTEXT] = p;
+
+            line++;
+
+            // Next line, \n or \r\n terminated
+            p += DOCTOR_LINE;
+
+            if ((p < end) && (*p == '\r')) p++;
+            if ((p < end) && (*p == '\n')) p++;
+
+            if (p < end) {
+                uint64_t step = cpu_fast_step(&gb->cpu, &gb->map) * M;
+
+                gb->sched.now += step;
+
+                if (scheduler_due(&gb->sched, gb->sched.now))
+                    scheduler_run(&gb->sched, gb->sched.now);
+            }
+        }
+
+        if (ok) std::fprintf(out, "All %llu lines match\n", (unsigned long long)line);
+
+        gb->map.read = mem_handler_read;
+
+        scheduler_schedule(&gb->sched, EV_CPU, gb->sched.now);
+        cpu_update_clocks(&gb->cpu, gb->sched.now);
+
+        mapped_file_close(&file);
+
+        return ok;
+    }
+}
@@ -2,12 +2,19 @@
 
 #include "macros.hpp"
 #include "structs.hpp"
+#include "memory_map.hpp"
+
+#include "scheduler/scheduler_struct.hpp"
+#include "scheduler/scheduler_funcs.hpp"
 
 // Hardware inside LR35902 SoC
 #include "lr35902/lr35902_struct.hpp"
 #include "lr35902/lr35902_funcs.hpp"
 #include "lr35902/cpu_struct.hpp"
 #include "lr35902/cpu_funcs.hpp"
+#include "lr35902/cpu_fast_funcs.hpp"
+#include "lr35902/bootrom_struct.hpp"
+#include "lr35902/bootrom_funcs.hpp"
 
 // Hardware outside LR35902 SoC
 #include "slot/slot_struct.hpp"
@@ -16,32 +23,257 @@
 #include "lh5264/lh5264_funcs.hpp"
 
 namespace gb {
-    struct gameboy_t {
-        lr35902_t        soc;
-        lh5264_t         wram;
-        cpu_t            cpu;
-        cartridge_slot_t slot;
+    // Every instance is a single flat block: hot state first, then
+    // the page tables, then the memories, all inline. Pointers between
+    // components only ever point inside the block (or at read-only ROM
+    // mappings), so an instance can be cloned or moved with a memcpy
+    // and a rebind, see clone()
+    struct alignas(64) gameboy_t {
+        alignas(64) cpu_t            cpu;
+        alignas(64) lr35902_t        soc;
+        alignas(64) scheduler_t      sched;
+        alignas(64) bootrom_t        boot;
+        alignas(64) cartridge_slot_t slot;
+
+        // Transaction-level view of the above, for the fast core
+        alignas(64) memory_map_t     map;
+
+        alignas(64) lh5264_t         wram;
+
+        // External cartridge RAM, unless it's battery backed
+        alignas(64) uint8_t          cart_ram[CART_RAM_MAX];
     };
 
+    void cpu_event(void* ctx, uint64_t now) {
+        gameboy_t* gb = (gameboy_t*)ctx;
+
+        // This clocks all hardware inside LR35902 SoC, hardware
+        // outside the SoC is notified of pin changes from there
+        lr35902_clock(&gb->soc, now);
+
+        scheduler_schedule(&gb->sched, EV_CPU, now + 1 + cpu_skippable_half_cycles(&gb->cpu));
+    }
+
+    void frame_event(void* ctx, uint64_t now) {
+        gameboy_t* gb = (gameboy_t*)ctx;
+
+        // Battery-backed RAM is written back once per frame
+        // at most, instead of on every write
+        slot_flush(&gb->slot);
+
+        scheduler_schedule(&gb->sched, EV_FRAME, now + FRAME);
+    }
+
+    // Accesses the memory map can't serve from host memory
+    uint8_t mem_handler_read(void* ctx, uint16_t addr) {
+        gameboy_t* gb = (gameboy_t*)ctx;
+
+        if (!(addr & 0x8000)) return slot_read(&gb->slot, addr);
+        if (RANGE(addr, 0xa000, 0xbfff)) return slot_read(&gb->slot, addr);
+
+        return 0xff;
+    }
+
+    void mem_handler_write(void* ctx, uint16_t addr, uint8_t data) {
+        gameboy_t* gb = (gameboy_t*)ctx;
+
+        if (!(addr & 0x8000)) slot_write(&gb->slot, addr, data);
+        if (RANGE(addr, 0xa000, 0xbfff)) slot_write(&gb->slot, addr, data);
+        if (addr == 0xff50) bootrom_write(&gb->boot, data);
+    }
+
+    void gameboy_map(gameboy_t* gb) {
+        mem_init(&gb->map);
+
+        gb->map.ctx = gb;
+        gb->map.read = mem_handler_read;
+        gb->map.write = mem_handler_write;
+
+        slot_map(&gb->slot, &gb->map);
+        lh5264_map(&gb->wram, &gb->map);
+        bootrom_map(&gb->boot, &gb->map);
+    }
+
     void init(gameboy_t* gb) {
         // Init hardware
         lr35902_init(&gb->soc);
         lh5264_init(&gb->wram, &gb->soc);
         cpu_init(&gb->cpu, &gb->soc);
-        slot_init(&gb->slot, &gb->soc);
+        bootrom_init(&gb->boot, &gb->soc);
+        slot_init(&gb->slot, &gb->soc, gb->cart_ram);
 
         // Assign CPU to LR35902
         gb->soc.cpu = &gb->cpu;
+
+        // Build the transaction-level memory map
+        gameboy_map(gb);
+
+        scheduler_init(&gb->sched);
+        scheduler_register(&gb->sched, EV_CPU, cpu_event, gb);
+        scheduler_register(&gb->sched, EV_FRAME, frame_event, gb);
+        scheduler_schedule(&gb->sched, EV_CPU, 0);
+        scheduler_schedule(&gb->sched, EV_FRAME, FRAME);
+    }
+
+    // Flushes battery-backed RAM and releases the cartridge
+    void destroy(gameboy_t* gb) {
+        slot_eject(&gb->slot);
+    }
+
+    // Move a pointer that points inside `from` to the same spot inside `to`
+    template <class P> void gameboy_rebase(P*& p, const gameboy_t* from, gameboy_t* to) {
+        const uint8_t* b = (const uint8_t*)p;
+
+        if ((b >= (const uint8_t*)from) && (b < (const uint8_t*)(from + 1)))
+            p = (P*)((uint8_t*)to + (b - (const uint8_t*)from));
+    }
+
+    // memcpy + rebind, `move` hands the cartridge's mappings over
+    // to `dst` instead of borrowing them
+    void gameboy_copy(gameboy_t* dst, const gameboy_t* src, bool move) {
+        // Everything but the unused tail of the cartridge RAM buffer
+        size_t head = (const uint8_t*)src->cart_ram - (const uint8_t*)src;
+
+        std::memcpy(dst, src, head);
+
+        if (src->slot.cart.ram == src->cart_ram)
+            std::memcpy(dst->cart_ram, src->cart_ram, src->slot.cart.ram_size);
+
+        gameboy_rebase(dst->soc.cpu, src, dst);
+        gameboy_rebase(dst->soc.boot, src, dst);
+
+        for (int i = 0; i < dst->soc.ext_pub.count; i++)
+            gameboy_rebase(dst->soc.ext_pub.listeners[i].ctx, src, dst);
+
+        gameboy_rebase(dst->cpu.main_bus_set, src, dst);
+        gameboy_rebase(dst->cpu.vram_bus_set, src, dst);
+        gameboy_rebase(dst->cpu.boot, src, dst);
+
+        gameboy_rebase(dst->wram.pins, src, dst);
+
+        cartridge_t* cart = &dst->slot.cart;
+
+        gameboy_rebase(dst->slot.pins, src, dst);
+        gameboy_rebase(dst->slot.ram_buffer, src, dst);
+        gameboy_rebase(cart->ram, src, dst);
+
+        if (!move) {
+            // Battery-backed RAM lives in the .sav mapping,
+            // clones get a private copy instead
+            if (cart->ram_file.data) {
+                std::memcpy(dst->cart_ram, cart->ram, cart->ram_size);
+
+                cart->ram = dst->cart_ram;
+            }
+
+            mapped_file_reset(&cart->rom_file);
+            mapped_file_reset(&cart->ram_file);
+        }
+
+        if (cart->rom) cartridge_update_banks(cart);
+
+        for (int i = 0; i < EV_COUNT; i++)
+            gameboy_rebase(dst->sched.ctx[i], src, dst);
+
+        gameboy_map(dst);
+    }
+
+    // Make `dst` an exact copy of `src`, no allocations involved.
+    //
+    // The clone borrows the ROM mapping, `src` (or whichever instance
+    // loaded the cartridge) must outlive it. Battery-backed RAM is
+    // copied into the clone's own buffer, clones never write saves
+    void clone(gameboy_t* dst, const gameboy_t* src) {
+        gameboy_copy(dst, src, false);
     }
 
+    // Move an instance to new storage, `src` is dead afterwards
+    // and must not be destroyed
+    void relocate(gameboy_t* dst, const gameboy_t* src) {
+        gameboy_copy(dst, src, true);
+    }
+
+    bool insert_cartridge(gameboy_t* gb, const char* path) {
+        return slot_insert(&gb->slot, path);
+    }
+
+    void eject_cartridge(gameboy_t* gb) {
+        slot_eject(&gb->slot);
+    }
+
+    // Fast start: instead of running the boot ROM (logo scroll
+    // and all), jump straight to the state it leaves behind.
+    // Call right after insert_cartridge, before clocking
+    void skip_boot(gameboy_t* gb) {
+        const bootrom_snapshot_t& s = bootrom_snapshot_dmg;
+
+        cpu_t* cpu = &gb->cpu;
+
+        cpu_init(cpu, &gb->soc);
+
+        std::memcpy(cpu->r, s.r, sizeof(s.r));
+
+        cpu->sp = s.sp;
+        cpu->pc = s.pc;
+        cpu->bus.pins = s.pins;
+
+        // The header checksum is the only thing the
+        // cartridge has a say in
+        if (gb->slot.cart.rom)
+            cpu->r[6] = bootrom_post_flags(cartridge_read_rom(&gb->slot.cart, 0x14d));
+
+        bootrom_write(&gb->boot, 1);
+    }
+
+    // Advance the pin-level model by `cycles` half cycles,
+    // only edges components registered get actually clocked
     void clock(gameboy_t* gb, int cycles = 1) {
-        while (cycles--) {
-            // This clocks all hardware inside LR35902 SoC
-            lr35902_clock(&gb->soc);
+        scheduler_run(&gb->sched, gb->sched.now + cycles);
+
+        // The CPU might have skipped the last few half cycles
+        cpu_update_clocks(&gb->cpu, gb->sched.now);
+    }
+
+    // Clock the pin-level core until the CPU sits on an
+    // instruction boundary, returns half cycles spent
+    uint64_t sync(gameboy_t* gb) {
+        uint64_t cycles = 0;
+
+        while (!cpu_at_boundary(&gb->cpu)) {
+            clock(gb);
 
-            // We also have to clock/update hardware outside the SoC
-            slot_clock(&gb->slot);
-            lh5264_update(&gb->wram);
+            cycles++;
         }
+
+        return cycles;
+    }
+
+    // Run the instruction-level core for at least `cycles`
+    // half cycles, stopping on the first instruction boundary
+    // after that. Pin-level clocking can be resumed with
+    // clock() right after, returns half cycles spent
+    uint64_t run_fast(gameboy_t* gb, uint64_t cycles) {
+        uint64_t spent = sync(gb);
+
+        // The pin-level CPU sits out while the fast core runs
+        scheduler_cancel(&gb->sched, EV_CPU);
+
+        while (spent < cycles) {
+            uint64_t step = cpu_fast_step(&gb->cpu, &gb->map) * M;
+
+            spent += step;
+
+            // Keep the master clock in step, and catch up on any
+            // other edges the instruction ran past
+            gb->sched.now += step;
+
+            if (scheduler_due(&gb->sched, gb->sched.now))
+                scheduler_run(&gb->sched, gb->sched.now);
+        }
+
+        scheduler_schedule(&gb->sched, EV_CPU, gb->sched.now);
+        cpu_update_clocks(&gb->cpu, gb->sched.now);
+
+        return spent;
     }
 }
\ No newline at end of file
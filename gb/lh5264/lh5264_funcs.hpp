@@ -2,17 +2,23 @@
 
 #include "../macros.hpp"
 #include "../structs.hpp"
+#include "../log.hpp"
+
+#include "../memory_map.hpp"
 
 #include "lh5264_struct.hpp"
 
 #include "../lr35902/lr35902_struct.hpp"
+#include "../lr35902/bus_funcs.hpp"
 
 namespace gb {
+    void lh5264_notify(void* ctx, uint32_t prev, uint32_t curr, uint32_t changed);
+
     void lh5264_init(lh5264_t* lh5264, lr35902_t* lr35902) {
-        lh5264->pins = lr35902->ext_bus;
+        lh5264->pins = &lr35902->ext_bus;
 
-        // Allocate 8KB
-        lh5264->memory = new uint8_t[0x2000];
+        // A0-A12, CE2 (A14), /CE1 (/CS), /WE (/WR), /OE (/RD)
+        bus_subscribe(&lr35902->ext_pub, 0x1fff | BUS_A14 | BUS_CS | BUS_WR | BUS_RD, lh5264_notify, lh5264);
 
         // Fill with test pattern (55 aa)
         for (int i = 0; i < 0x2000; i++) {
@@ -35,33 +41,47 @@ namespace gb {
         //  L      H     H     L     Read      Output
         //  L      H     H     H     No Output High-Z
         
-        bool we = lh5264->pins->wr;
-        bool oe = lh5264->pins->rd;
-        bool ce1 = lh5264->pins->cs;
+        uint32_t pins = lh5264->pins->pins;
+
+        // Pins that went from high to low since the last update
+        uint32_t fell = lh5264->prev & ~pins;
+
+        bool ce1 = pins & BUS_CS;
 
         // Connected to A14
-        bool ce2 = lh5264->pins->a & 0x4000;
+        bool ce2 = pins & BUS_A14;
 
         // A0-A12
-        uint16_t addr = lh5264->pins->a & 0x1fff;
+        uint16_t addr = pins & 0x1fff;
 
         // Non-standby mode
         if (ce2 && !ce1) {
             // Write mode
             // Trigger write on WR falling edge
-            if ((!we) && lh5264->prev_we) {
-                //_log(debug, "WRAM write %04x -> %02x", lh5264->pins->a, lh5264->pins->d);
+            if (fell & BUS_WR) {
+                _logc(wram, debug, "WRAM write %04x -> %02x", bus_a(lh5264->pins), bus_d(lh5264->pins));
 
-                lh5264->memory[addr] = lh5264->pins->d;
+                lh5264->memory[addr] = bus_d(lh5264->pins);
             } else {
                 // Read mode
-                if (!oe) {
-                    lh5264->pins->d = lh5264->memory[addr];
+                if (!(pins & BUS_RD)) {
+                    bus_set_d(lh5264->pins, lh5264->memory[addr]);
                 } // Else no output
             }
         } // Else standby
 
-        lh5264->prev_we = we;
-        lh5264->prev_oe = oe;
+        lh5264->prev = pins;
+    }
+
+    void lh5264_notify(void* ctx, uint32_t prev, uint32_t curr, uint32_t changed) {
+        lh5264_update((lh5264_t*)ctx);
+    }
+
+    // Transaction-level mapping, used by the fast core.
+    // CE2 is connected to A14 and only A0-A12 are decoded,
+    // so WRAM shows up at c000-dfff and is echoed at e000-fdff
+    void lh5264_map(lh5264_t* lh5264, memory_map_t* map) {
+        mem_map(map, 0xc000, 0xdfff, lh5264->memory, lh5264->memory);
+        mem_map(map, 0xe000, 0xfdff, lh5264->memory, lh5264->memory);
     }
 }
\ No newline at end of file
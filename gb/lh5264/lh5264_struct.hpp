@@ -15,9 +15,10 @@ namespace gb {
     struct lh5264_t {
         bus_t* pins;
 
-        bool prev_we;
-        bool prev_oe;
+        // Pins on the last update, for edge detection
+        uint32_t prev;
 
-        uint8_t* memory;
+        // Inline, so the chip needs no allocation
+        alignas(64) uint8_t memory[0x2000];
     };
 }
\ No newline at end of file
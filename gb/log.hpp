@@ -3,6 +3,10 @@
 #include <iostream>
 #include <fstream>
 #include <cstdio>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
 
 #define _ESCAPE_BRACKET "["
 #define _ESCAPE_M       "m"
@@ -84,6 +88,19 @@ namespace _log {
         mask_all     = 0b00111111
     };
 
+    // Every call site belongs to a category, see _logc
+    enum category_t : uint32_t {
+        cat_general = 1 << 0,   // Frontend, batch runner, plain _log
+        cat_cpu     = 1 << 1,
+        cat_bus     = 1 << 2,
+        cat_wram    = 1 << 3,
+        cat_slot    = 1 << 4,   // Cartridge slot and MBCs
+        cat_state   = 1 << 5,   // Save states
+        cat_file    = 1 << 6,   // Mapped files
+        cat_trace   = 1 << 7,
+        cat_all     = 0xffffffff
+    };
+
     const char* type_text[] = {
         "none",
         "debug",
@@ -93,29 +110,53 @@ namespace _log {
         "error"
     };
 
-    bool disable_logs = false;
+    std::atomic<bool> disable_logs { false };
 
     namespace settings {
         bool disable_escape = false;
         bool bright_colors = true;
-        type_mask_t mask = mask_all;
+
+        // Both can be changed at any time, from any thread
+        std::atomic<uint32_t> mask { mask_all };
+
+        // Only narrows what LOG_CATEGORIES compiled in
+        std::atomic<uint32_t> categories { cat_all };
+
         std::string app_name;
         std::ofstream file;
+        std::mutex file_mutex;
     }
 
     bool is_allowed(int type) {
+        uint32_t mask = settings::mask.load(std::memory_order_relaxed);
+
         switch (type) {
-            case none   : return settings::mask & mask_none;
-            case debug  : return settings::mask & mask_debug;
-            case ok     : return settings::mask & mask_ok;
-            case info   : return settings::mask & mask_info;
-            case warning: return settings::mask & mask_warning;
-            case error  : return settings::mask & mask_error;
+            case none   : return mask & mask_none;
+            case debug  : return mask & mask_debug;
+            case ok     : return mask & mask_ok;
+            case info   : return mask & mask_info;
+            case warning: return mask & mask_warning;
+            case error  : return mask & mask_error;
         }
 
         return false;
     }
 
+    inline bool is_enabled(uint32_t category, int type) {
+        if (disable_logs.load(std::memory_order_relaxed)) return false;
+        if (!(settings::categories.load(std::memory_order_relaxed) & category)) return false;
+
+        return is_allowed(type);
+    }
+
+    void enable_categories(uint32_t categories) {
+        settings::categories.fetch_or(categories, std::memory_order_relaxed);
+    }
+
+    void disable_categories(uint32_t categories) {
+        settings::categories.fetch_and(~categories, std::memory_order_relaxed);
+    }
+
     void disable() {
         disable_logs = true;
     }
@@ -124,23 +165,29 @@ namespace _log {
         disable_logs = false;
     }
 
-    template <class... Args> void log(int type, std::string text, Args... args) {
-        if (disable_logs) return;
-        if (!is_allowed(type)) return;
-
-        static char buf[0x400];
+    // Callers go through _log/_logc, which already checked is_enabled
+    template <class... Args> void log(int type, const char* text, Args... args) {
+        // On the stack, instances on other threads log too
+        char buf[0x400];
 
-        std::sprintf(buf, text.c_str(), args...);
+        std::snprintf(buf, sizeof(buf), text, args...);
 
         const char** cols = settings::bright_colors ? colors_high : colors_low;
 
+        // Build whole lines so lines from different threads don't interleave
+        std::string line;
+
         if (settings::disable_escape) {
-            std::cout << settings::app_name << ": " << type_text[type] << ": " << buf << std::endl;
+            line = settings::app_name + ": " + type_text[type] + ": " + buf + "\n";
         } else {
-            std::cout << settings::app_name << ": " << cols[color_indexes[type]] << type_text[type] << ": " << ESCAPE(0) << buf << std::endl;
+            line = settings::app_name + ": " + cols[color_indexes[type]] + type_text[type] + ": " + ESCAPE(0) + buf + "\n";
         }
 
+        std::cout << line << std::flush;
+
         if (settings::file.is_open()) {
+            std::lock_guard<std::mutex> lock(settings::file_mutex);
+
             settings::file << settings::app_name << ": " << type_text[type] << ": " << buf << std::endl;
         }
     }
@@ -156,4 +203,28 @@ namespace _log {
     }
 }
 
-#define _log(t, ...) _log::log(_log::t, __VA_ARGS__)
\ No newline at end of file
+// Calls below LOG_MIN_LEVEL, or in a category outside LOG_CATEGORIES,
+// compile to nothing, arguments included. Everything else is checked
+// against the runtime masks first (settings::mask, settings::categories)
+//
+// Per-access categories (cat_wram) sit on hot paths, they're left
+// out unless LOG_CATEGORIES names them
+//
+// e.g. -DLOG_MIN_LEVEL=_log::info -DLOG_CATEGORIES="(_log::cat_general|_log::cat_slot)"
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL _log::none
+#endif
+
+#ifndef LOG_CATEGORIES
+#define LOG_CATEGORIES (_log::cat_all & ~_log::cat_wram)
+#endif
+
+#define _logc(c, t, ...) \
+    do { \
+        if constexpr ((_log::t >= LOG_MIN_LEVEL) && (_log::cat_##c & (LOG_CATEGORIES))) { \
+            if (_log::is_enabled(_log::cat_##c, _log::t)) \
+                _log::log(_log::t, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define _log(t, ...) _logc(general, t, __VA_ARGS__)
\ No newline at end of file
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "../structs.hpp"
+#include "../macros.hpp"
+
+#include "../memory_map.hpp"
+
+#include "bootrom_struct.hpp"
+#include "lr35902_struct.hpp"
+#include "bus_funcs.hpp"
+
+namespace gb {
+    // Read-only, so every instance can share it
+    const uint8_t dmg_boot_rom[] = {
+        0x31, 0xfe, 0xff, 0xaf, 0x21, 0xff, 0x9f, 0x32, 0xcb, 0x7c, 0x20, 0xfb,
+        0x21, 0x26, 0xff, 0x0e, 0x11, 0x3e, 0x80, 0x32, 0xe2, 0x0c, 0x3e, 0xf3,
+        0xe2, 0x32, 0x3e, 0x77, 0x77, 0x3e, 0xfc, 0xe0, 0x47, 0x11, 0x04, 0x01,
+        0x21, 0x10, 0x80, 0x1a, 0xcd, 0x95, 0x00, 0xcd, 0x96, 0x00, 0x13, 0x7b,
+        0xfe, 0x34, 0x20, 0xf3, 0x11, 0xd8, 0x00, 0x06, 0x08, 0x1a, 0x13, 0x22,
+        0x23, 0x05, 0x20, 0xf9, 0x3e, 0x19, 0xea, 0x10, 0x99, 0x21, 0x2f, 0x99,
+        0x0e, 0x0c, 0x3d, 0x28, 0x08, 0x32, 0x0d, 0x20, 0xf9, 0x2e, 0x0f, 0x18,
+        0xf3, 0x67, 0x3e, 0x64, 0x57, 0xe0, 0x42, 0x3e, 0x91, 0xe0, 0x40, 0x04,
+        0x1e, 0x02, 0x0e, 0x0c, 0xf0, 0x44, 0xfe, 0x90, 0x20, 0xfa, 0x0d, 0x20,
+        0xf7, 0x1d, 0x20, 0xf2, 0x0e, 0x13, 0x24, 0x7c, 0x1e, 0x83, 0xfe, 0x62,
+        0x28, 0x06, 0x1e, 0xc1, 0xfe, 0x64, 0x20, 0x06, 0x7b, 0xe2, 0x0c, 0x3e,
+        0x87, 0xe2, 0xf0, 0x42, 0x90, 0xe0, 0x42, 0x15, 0x20, 0xd2, 0x05, 0x20,
+        0x4f, 0x16, 0x20, 0x18, 0xcb, 0x4f, 0x06, 0x04, 0xc5, 0xcb, 0x11, 0x17,
+        0xc1, 0xcb, 0x11, 0x17, 0x05, 0x20, 0xf5, 0x22, 0x23, 0x22, 0x23, 0xc9,
+        0xce, 0xed, 0x66, 0x66, 0xcc, 0x0d, 0x00, 0x0b, 0x03, 0x73, 0x00, 0x83,
+        0x00, 0x0c, 0x00, 0x0d, 0x00, 0x08, 0x11, 0x1f, 0x88, 0x89, 0x00, 0x0e,
+        0xdc, 0xcc, 0x6e, 0xe6, 0xdd, 0xdd, 0xd9, 0x99, 0xbb, 0xbb, 0x67, 0x63,
+        0x6e, 0x0e, 0xec, 0xcc, 0xdd, 0xdc, 0x99, 0x9f, 0xbb, 0xb9, 0x33, 0x3e,
+        0x3c, 0x42, 0xb9, 0xa5, 0xb9, 0xa5, 0x42, 0x3c, 0x21, 0x04, 0x01, 0x11,
+        0xa8, 0x00, 0x1a, 0x13, 0xbe, 0x20, 0xfe, 0x23, 0x7d, 0xfe, 0x34, 0x20,
+        0xf5, 0x06, 0x19, 0x78, 0x86, 0x23, 0x05, 0x20, 0xfb, 0x86, 0x20, 0xfe,
+        0x3e, 0x01, 0xe0, 0x50
+    };
+
+    static_assert(sizeof(dmg_boot_rom) == 0x100, "DMG boot ROM must be 256 bytes");
+
+    void bootrom_init(bootrom_t* boot, lr35902_t* lr35902) {
+        std::memset(boot, 0, sizeof(bootrom_t));
+
+        boot->rom = dmg_boot_rom;
+
+        lr35902->boot = boot;
+    }
+
+    // Transaction-level mapping, used by the fast core.
+    // Laid over whatever the cartridge maps at 0000-00ff
+    void bootrom_map(bootrom_t* boot, memory_map_t* map) {
+        boot->map = map;
+
+        mem_overlay(map, boot->boot_off ? nullptr : boot->rom);
+    }
+
+    uint8_t bootrom_read(bootrom_t* boot, uint16_t addr) {
+        return boot->rom[addr & 0xff];
+    }
+
+    // Writes to ff50, anything non-zero unmaps the
+    // boot ROM until the next power cycle
+    void bootrom_write(bootrom_t* boot, uint8_t data) {
+        if (boot->boot_off || !data) return;
+
+        boot->boot_off = true;
+
+        if (boot->map) mem_overlay(boot->map, nullptr);
+    }
+
+    // F is left by the header checksum check, the final
+    // add (0x14d) lands on zero for any valid header
+    constexpr uint8_t bootrom_post_flags(uint8_t checksum) {
+        uint8_t a = -checksum;
+
+        uint8_t f = 0x80;
+
+        if (((a & 0xf) + (checksum & 0xf)) > 0xf) f |= 0x20;
+        if ((a + checksum) > 0xff) f |= 0x10;
+
+        return f;
+    }
+
+    // What the DMG boot ROM leaves behind, right before the
+    // first fetch from the cartridge. The CPU's bus is idle,
+    // WRAM is untouched and ff50 is set
+    constexpr bootrom_snapshot_t bootrom_snapshot_generate_dmg() {
+        bootrom_snapshot_t s = {};
+
+        // ld c, 0x13 (sound init), then the logo compare leaves
+        // DE at 00d8 and the header checksum leaves HL at 014d
+        s.r[0] = 0x00;
+        s.r[1] = 0x13;
+        s.r[2] = 0x00;
+        s.r[3] = 0xd8;
+        s.r[4] = 0x01;
+        s.r[5] = 0x4d;
+
+        // Any non-zero checksum, patched from the header
+        s.r[6] = bootrom_post_flags(0xe7);
+
+        // ld a, 1 ; ldh (0x50), a
+        s.r[7] = 0x01;
+
+        s.sp = 0xfffe;
+        s.pc = 0x0100;
+        s.pins = bus_pins(0x8000, 0x00, true, true, true);
+
+        return s;
+    }
+
+    constexpr bootrom_snapshot_t bootrom_snapshot_dmg = bootrom_snapshot_generate_dmg();
+
+    static_assert(bootrom_snapshot_dmg.r[6] == 0xb0, "DMG boot leaves F=b0 on common headers");
+}
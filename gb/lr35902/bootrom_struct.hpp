@@ -9,11 +9,23 @@
 #include "cpu_struct.hpp"
 
 namespace gb {
+    // The boot ROM sits inside the SoC, it shadows 0000-00ff
+    // until the first write to ff50 and never shows up on the pins
     struct bootrom_t {
-        bus_t* pins;
-
         bool boot_off;
 
-        uint8_t* rom;
+        const uint8_t* rom;
+
+        // Transaction-level map to lift the overlay from on unmap
+        memory_map_t* map;
+    };
+
+    // Machine state right as the boot ROM hands over to the
+    // cartridge, see bootrom_skip
+    struct bootrom_snapshot_t {
+        uint8_t r[8];       // B, C, D, E, H, L, F, A
+        uint16_t sp;
+        uint16_t pc;
+        uint32_t pins;      // CPU's bus
     };
-}
\ No newline at end of file
+}
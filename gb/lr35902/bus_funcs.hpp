@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "../structs.hpp"
+#include "../macros.hpp"
+#include "../log.hpp"
+
+#include "bus_struct.hpp"
+
+namespace gb {
+    constexpr uint32_t bus_pins(uint16_t a, uint8_t d, bool wr, bool rd, bool cs) {
+        return ((uint32_t)a) |
+               ((uint32_t)d << 16) |
+               (wr ? (uint32_t)BUS_WR : 0u) |
+               (rd ? (uint32_t)BUS_RD : 0u) |
+               (cs ? (uint32_t)BUS_CS : 0u);
+    }
+
+    inline uint16_t bus_a(const bus_t* bus) { return bus->pins & BUS_A; }
+    inline uint8_t bus_d(const bus_t* bus) { return (bus->pins & BUS_D) >> 16; }
+    inline bool bus_wr(const bus_t* bus) { return bus->pins & BUS_WR; }
+    inline bool bus_rd(const bus_t* bus) { return bus->pins & BUS_RD; }
+    inline bool bus_cs(const bus_t* bus) { return bus->pins & BUS_CS; }
+
+    // Devices driving D0-D7
+    inline void bus_set_d(bus_t* bus, uint8_t d) {
+        bus->pins = (bus->pins & ~BUS_D) | ((uint32_t)d << 16);
+    }
+
+    void bus_publisher_init(bus_publisher_t* pub, const bus_t* bus) {
+        std::memset(pub, 0, sizeof(bus_publisher_t));
+
+        pub->prev = bus->pins;
+    }
+
+    void bus_subscribe(bus_publisher_t* pub, uint32_t mask, bus_notify_t notify, void* ctx) {
+        if (pub->count == BUS_MAX_LISTENERS) {
+            _logc(bus, error, "Too many devices on a single bus");
+
+            std::exit(1);
+        }
+
+        pub->listeners[pub->count++] = { mask, notify, ctx };
+    }
+
+    // Notify every device whose pins toggled since the last call.
+    // Devices may drive the bus themselves (D0-D7 on reads), that
+    // is folded into the reference state without re-notifying
+    void bus_publish(bus_publisher_t* pub, const bus_t* bus) {
+        uint32_t curr = bus->pins;
+        uint32_t changed = curr ^ pub->prev;
+
+        if (!changed) return;
+
+        for (int i = 0; i < pub->count; i++) {
+            bus_listener_t* l = &pub->listeners[i];
+
+            if (l->mask & changed) {
+                l->notify(l->ctx, pub->prev, curr, changed);
+            }
+        }
+
+        pub->prev = bus->pins;
+    }
+}
@@ -7,11 +7,41 @@
 #include "../macros.hpp"
 
 namespace gb {
+    // Every pin packed into a single word, laid out as below, so
+    // copying, comparing or tracing a bus is a single load/store.
+    // Individual pins go through the bus_* accessors (bus_funcs.hpp)
     struct bus_t {
-        uint16_t a;     // Ext bus Address      A0-A15
-        uint8_t d;      // Ext bus Data         D0-D7
-        bool wr;        // Ext bus Write        /WR
-        bool rd;        // Ext bus Read         /RD
-        bool cs;        // Ext bus Chip Select  /CS
+        uint32_t pins;
     };
-}
\ No newline at end of file
+
+    // Bit layout of bus_t::pins
+    enum bus_pin_mask_t : uint32_t {
+        BUS_A   = 0x0000ffff,   // A0-A15
+        BUS_A14 = 0x00004000,
+        BUS_A15 = 0x00008000,
+        BUS_D   = 0x00ff0000,   // D0-D7
+        BUS_WR  = 0x01000000,   // /WR
+        BUS_RD  = 0x02000000,   // /RD
+        BUS_CS  = 0x04000000    // /CS
+    };
+
+    // Called with the pins before and after a transition,
+    // and the mask of pins that toggled
+    typedef void (*bus_notify_t)(void*, uint32_t, uint32_t, uint32_t);
+
+    struct bus_listener_t {
+        uint32_t mask;  // Pins this device cares about
+        bus_notify_t notify;
+        void* ctx;
+    };
+
+    #define BUS_MAX_LISTENERS 4
+
+    // Publishes transitions on a bus to the devices hooked to it
+    struct bus_publisher_t {
+        uint32_t prev;
+
+        bus_listener_t listeners[BUS_MAX_LISTENERS];
+        int count;
+    };
+}
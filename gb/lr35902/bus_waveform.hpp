@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../macros.hpp"
+#include "../structs.hpp"
+
+#include "bus_struct.hpp"
+#include "cpu_defines.hpp"
+
+// External bus protocol, as a fixed pin waveform per access type,
+// region and half cycle. Each half cycle is one packed pin word
+// (see bus_pin_mask_t):
+//
+//   pins = (pins & keep) | set | (latches & latch)
+//
+// where latches is the address latch in A0-A15 and the data latch
+// in D0-D7. The CPU never touches its pins any other way.
+//
+// For reads to all regions:
+// Address is put onto A0-A14 on ck=1
+// RD is pulled low on ck=0
+// WR is pulled high on ck=0
+// ---
+// For reads to 0000-7fff:
+// A15 is pulled high on ck=0 then pulled low on ck=2
+// CS is pulled high on ck=0
+// ---
+// For reads to a000-fdff
+// A15 is pulled high on ck=0
+// CS is pulled high on ck=0 then pulled low on ck=2
+// ---
+// For reads to fe00-ffff
+// Both A15 and CS are pulled high on ck=0
+// ---
+// Writes to 0000-7fff and a000-fdff also pull RD back high on ck=1,
+// pull WR low and drive D0-D7 on ck=3. Every write pulls WR high
+// again on ck=6.
+// ---
+// Idle cycles release the bus on ck=0: A15, RD, WR and CS high,
+// A0-A14 and D0-D7 low.
+
+namespace gb {
+    struct bus_wave_t {
+        uint32_t keep;      // Pins carried over from the previous half cycle
+        uint32_t set;       // Pins driven high
+        uint32_t latch;     // Pins driven from the address/data latches
+    };
+
+    struct bus_waveform_t {
+        bus_wave_t wave[BA_COUNT][BR_COUNT][8];
+
+        // Half cycles (bit per ck) on which the SoC routes
+        // the CPU's bus out, by region, see lr35902_clock
+        uint8_t external[BR_COUNT];
+    };
+
+    constexpr bus_wave_t bus_wave_dmg(uint8_t access, uint8_t region, uint8_t ck) {
+        // Boot ROM accesses look like ROM accesses on the
+        // pins, they just never leave the SoC
+        bool rom = (region == BR_ROM) || (region == BR_BOOT);
+        bool ram = region == BR_RAM;
+        bool write = access == BA_WRITE;
+
+        // Nothing changes
+        bus_wave_t w = { ~0u, 0, 0 };
+
+        if (access == BA_IDLE) {
+            if (ck == 0) w = { 0, BUS_A15 | BUS_WR | BUS_RD | BUS_CS, 0 };
+
+            return w;
+        }
+
+        switch (ck) {
+            case 0: {
+                w.keep = ~(BUS_A15 | BUS_WR | BUS_RD | BUS_CS);
+                w.set = BUS_A15 | BUS_WR | BUS_CS;
+            } break;
+
+            case 1: {
+                w.keep = ~(BUS_A & ~BUS_A15);
+                w.latch = BUS_A & ~BUS_A15;
+
+                if (write && (rom || ram)) {
+                    w.keep &= ~BUS_RD;
+                    w.set |= BUS_RD;
+                }
+            } break;
+
+            case 2: {
+                if (rom) w.keep = ~BUS_A15;
+                if (ram) w.keep = ~BUS_CS;
+            } break;
+
+            case 3: {
+                if (write && (rom || ram)) {
+                    w.keep = ~(BUS_WR | BUS_D);
+                    w.latch = BUS_D;
+                }
+            } break;
+
+            case 6: {
+                if (write) {
+                    w.keep = ~BUS_WR;
+                    w.set = BUS_WR;
+                }
+            } break;
+        }
+
+        return w;
+    }
+
+    constexpr bus_waveform_t bus_waveform_generate_dmg() {
+        bus_waveform_t t = {};
+
+        for (int access = 0; access < BA_COUNT; access++)
+            for (int region = 0; region < BR_COUNT; region++)
+                for (int ck = 0; ck < 8; ck++)
+                    t.wave[access][region][ck] = bus_wave_dmg(access, region, ck);
+
+        // From the select on ck=2 until the end of the M cycle
+        t.external[BR_ROM] = 0xfc;
+        t.external[BR_RAM] = 0xfc;
+
+        return t;
+    }
+
+    // Indexed by cpu_t::waveform, other SoC revisions go here
+    constexpr bus_waveform_t bus_waveforms[] = {
+        bus_waveform_generate_dmg()     // BW_DMG
+    };
+}
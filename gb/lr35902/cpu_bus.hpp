@@ -5,44 +5,71 @@
 #include "../log.hpp"
 
 #include "lr35902_struct.hpp"
+#include "bootrom_struct.hpp"
+#include "bus_funcs.hpp"
+#include "bus_waveform.hpp"
 
 #include "cpu_struct.hpp"
 
 namespace gb {
-    // For reads to all regions:
-    // Address is put onto A0-A14 on ck=1
-    // RD is pulled low on ck=0
-    // WR is pulled high on ck=0
-    // ---
-    // For reads to 0000-7fff:
-    // A15 is pulled high on ck=0 then pulled low on ck=2
-    // CS is pulled high on ck=0
-    // ---
-    // For reads to a000-fdff
-    // A15 is pulled high on ck=0
-    // CS is pulled high on ck=0 then pulled low on ck=2
-    // ---
-    // For reads to fe00-ffff
-    // Both A15 and CS are pulled high on ck=0
+    // Addresses are classified into a region once, when latched,
+    // the pins then follow the region's waveform (bus_waveform.hpp)
+
+    // Region by the high byte of the address
+    struct bus_region_map_t {
+        uint8_t page[256];
+    };
+
+    constexpr bus_region_map_t bus_region_generate() {
+        bus_region_map_t m = {};
+
+        for (int p = 0; p < 256; p++) {
+            if (p <= 0x7f) m.page[p] = BR_ROM;
+            else if ((p >= 0xa0) && (p <= 0xfd)) m.page[p] = BR_RAM;
+            else m.page[p] = BR_INTERNAL;
+        }
+
+        return m;
+    }
+
+    constexpr bus_region_map_t bus_region_map = bus_region_generate();
+
+    inline uint8_t cpu_bus_region(cpu_t* cpu, uint16_t addr) {
+        if ((addr <= 0xff) && !(*cpu->boot)->boot_off)
+            return BR_BOOT;
+
+        return bus_region_map.page[addr >> 8];
+    }
+
     void cpu_init_read(cpu_t* cpu, uint16_t addr) {
         cpu->read_ongoing = true;
         cpu->a_latch = addr;
+        cpu->region = cpu_bus_region(cpu, addr);
     }
 
     void cpu_init_write(cpu_t* cpu, uint16_t addr, uint8_t data) {
         cpu->write_ongoing = true;
         cpu->a_latch = addr;
         cpu->d_latch = data;
+        cpu->region = cpu_bus_region(cpu, addr);
+    }
+
+    // Drive the pins for the current half cycle
+    // of an access of type `access`
+    inline void cpu_bus_drive(cpu_t* cpu, uint8_t access) {
+        const bus_wave_t& w = bus_waveforms[cpu->waveform].wave[access][cpu->region][cpu->ck_half_cycle];
+
+        uint32_t latches = cpu->a_latch | ((uint32_t)cpu->d_latch << 16);
+
+        cpu->bus.pins = (cpu->bus.pins & w.keep) | w.set | (latches & w.latch);
     }
 
     void cpu_init_idle(cpu_t* cpu) {
-        // Initialize bus to idle state
-        cpu->bus.rd = true;
-        cpu->bus.wr = true;
-        cpu->bus.a = 0x8000;
-        cpu->bus.cs = true;
-        cpu->bus.d = 0x0;
         cpu->idle_cycle = true;
+        cpu->region = BR_INTERNAL;
+
+        // Release the bus
+        cpu_bus_drive(cpu, BA_IDLE);
     }
 
     bool cpu_handle_idle(cpu_t* cpu) {
@@ -56,97 +83,24 @@ namespace gb {
     }
 
     bool cpu_handle_write(cpu_t* cpu) {
-        switch (cpu->ck_half_cycle) {
-            case 0: {
-                cpu->bus.wr = true;
-                cpu->bus.rd = false;
-
-                // Pull A15 and CS high
-                cpu->bus.a |= 0x8000;
-                cpu->bus.cs = true;
-
-            } break;
-
-            case 1: {
-                if (RANGE(cpu->a_latch, 0x0000, 0x7fff) || RANGE(cpu->a_latch, 0xa000, 0xfdff)) {
-                    cpu->bus.rd = true;
-                }
-
-                // Keep A15
-                cpu->bus.a &= 0x8000;
-
-                // Latch address into A lines
-                cpu->bus.a |= cpu->a_latch & 0x7fff;
-            } break;
+        cpu_bus_drive(cpu, BA_WRITE);
 
-            case 2: {
-                if (RANGE(cpu->a_latch, 0x0000, 0x7fff)) {
-                    // A15 pulled low
-                    cpu->bus.a &= 0x7fff;
-                } else if (RANGE(cpu->a_latch, 0xa000, 0xfdff)) {
-                    cpu->bus.cs = false;
-                }
-            } break;
-
-            case 3: {
-                if (RANGE(cpu->a_latch, 0x0000, 0x7fff) || RANGE(cpu->a_latch, 0xa000, 0xfdff)) {
-                    // WR goes low
-                    cpu->bus.wr = false;
-
-                    // and data is latched into D lines
-                    cpu->bus.d = cpu->d_latch;
-                }
-            } break;
-
-            case 6: {
-                // WR is pulled high
-                cpu->bus.wr = true;
-            } break;
-
-            case 7: {
-                cpu->write_ongoing = false;
-
-                return false;
-            }
+        if (cpu->ck_half_cycle == 7) {
+            cpu->write_ongoing = false;
 
-            default: {
-                // CPU doesn't change signals
-            } break;
+            return false;
         }
 
         return true;
     }
 
     bool cpu_handle_read(cpu_t* cpu, uint8_t* dest) {
-        switch (cpu->ck_half_cycle) {
-            case 0: {
-                cpu->bus.wr = true;
-                cpu->bus.rd = false;
-
-                // Pull A15 and CS high
-                cpu->bus.a |= 0x8000;
-                cpu->bus.cs = true;
-            } break;
-
-            case 1: {
-                // Keep A15
-                cpu->bus.a &= 0x8000;
-
-                // Latch address into A lines
-                cpu->bus.a |= cpu->a_latch & 0x7fff;
-            } break;
-
-            case 2: {
-                if (RANGE(cpu->a_latch, 0x0000, 0x7fff)) {
-                    cpu->bus.a &= 0x7fff;
-                } else if (RANGE(cpu->a_latch, 0xa000, 0xfdff)) {
-                    cpu->bus.cs = false;
-                }
-            } break;
+        cpu_bus_drive(cpu, BA_READ);
 
+        switch (cpu->ck_half_cycle) {
             // Latch data pins into destination
             case 6: {
-                *dest = cpu->bus.d;
+                *dest = bus_d(&cpu->bus);
             } break;
 
             case 7: {
@@ -156,7 +110,7 @@ namespace gb {
             } break;
 
             default: {
-                // CPU doesn't change signals, waiting for data
+                // Waiting for data
             } break;
         }
 
@@ -3,6 +3,8 @@
 #include "../macros.hpp"
 #include "../structs.hpp"
 
+#include <cstdint>
+
 namespace gb {
     enum cpu_state_t {
         ST_FETCH,
@@ -19,5 +21,68 @@ namespace gb {
         IS_LAST_CYCLE
     };
 
+    // Bus regions, an access is classified once when
+    // its address is latched, see cpu_bus_region
+    enum bus_region_t : uint8_t {
+        BR_INTERNAL,    // 8000-9fff, fe00-ffff and idle cycles
+        BR_ROM,         // 0000-7fff
+        BR_RAM,         // a000-fdff, cartridge RAM and WRAM
+        BR_BOOT,        // 0000-00ff while the boot ROM is mapped
+        BR_COUNT
+    };
+
+    // Bus access types, see bus_waveform.hpp
+    enum bus_access_t : uint8_t {
+        BA_READ,
+        BA_WRITE,
+        BA_IDLE,
+        BA_COUNT
+    };
+
+    // Pin waveform variants (bus_waveforms)
+    enum bus_waveform_id_t : uint8_t {
+        BW_DMG
+    };
+
+    // Flag-setting ALU ops, for lazy flags
+    enum alu_op_t : uint8_t {
+        ALU_NONE,       // F is up to date
+        ALU_ADD,
+        ALU_SUB,        // sub and cp
+        ALU_AND,
+        ALU_OR,         // or and xor
+        ALU_INC,        // inc and dec, only the result matters
+        ALU_SET         // Z, N, H and C given as is (CB rotates and shifts)
+    };
+
+    // CB rotates and shifts, by bits 3-5 of the CB opcode
+    enum cb_rot_t : uint8_t {
+        CB_RLC,
+        CB_RRC,
+        CB_RL,
+        CB_RR,
+        CB_SLA,
+        CB_SRA,
+        CB_SWAP,
+        CB_SRL
+    };
+
+    // Where the threaded dispatch engine picks up on the
+    // next half cycle, see cpu_clock
+    enum cpu_resume_t {
+        RS_HANDLER,     // Call the instruction handler
+        RS_READ,        // Middle of a handler's read
+        RS_WRITE,       // Middle of a handler's write
+        RS_IDLE,        // Middle of an idle M cycle
+        RS_FETCH,       // Opcode fetch (ST_FETCH)
+        RS_PREFETCH,    // Opcode fetch overlapped with LAST
+        RS_NONE,        // Not clocked (test, halt, stop)
+        RS_COUNT
+    };
+
     typedef instruction_state_t (*cpu_instruction_t)(cpu_t*);
+
+    // Instruction-level handlers return the number of M cycles
+    // spent before the LAST cycle
+    typedef uint8_t (*cpu_fast_instruction_t)(cpu_t*, memory_map_t*);
 }
\ No newline at end of file
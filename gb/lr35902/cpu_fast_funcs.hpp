@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../macros.hpp"
+#include "../structs.hpp"
+#include "../memory_map.hpp"
+
+#include "cpu_struct.hpp"
+#include "cpu_fast_instructions.hpp"
+#include "cpu_fast_table.hpp"
+
+namespace gb {
+    // The fast core shares cpu_t with the pin-level core, but only
+    // understands instruction boundaries. A boundary is the point
+    // right after the (overlapped) opcode fetch completes:
+    // i_latch holds the next opcode, PC points past it, and
+    // no bus transaction is in flight.
+    //
+    // The initial ST_FETCH state (nothing fetched yet) is also
+    // a valid boundary.
+    bool cpu_at_boundary(cpu_t* cpu) {
+        if (cpu->ck_half_cycle) return false;
+        if (cpu->read_ongoing || cpu->write_ongoing || cpu->idle_cycle) return false;
+
+        switch (cpu->state) {
+            case ST_FETCH: return true;
+            case ST_EXECUTE: return !cpu->ex_m_cycle;
+        }
+
+        return false;
+    }
+
+    // Execute a single instruction, returns M cycles taken.
+    // Must only be called on an instruction boundary, and
+    // leaves the CPU on the next one.
+    //
+    // Bus pins are left untouched, the pin-level core
+    // re-drives them on its next access anyway.
+    uint8_t cpu_fast_step(cpu_t* cpu, memory_map_t* map) {
+        uint8_t m_cycles = 0;
+
+        if (cpu->state == ST_FETCH) {
+            cpu->i_latch = mem_read(map, cpu->pc++);
+            cpu->state = ST_EXECUTE;
+
+            m_cycles++;
+        }
+
+        m_cycles += fast_instruction_table[cpu->i_latch](cpu, map);
+
+        // LAST cycle, overlapped with the next fetch
+        cpu->temp_i_latch = mem_read(map, cpu->pc++);
+        cpu->i_latch = cpu->temp_i_latch;
+        cpu->ex_m_cycle = 0;
+        cpu->resume = RS_HANDLER;
+
+        m_cycles++;
+
+        // 2 half cycles per T cycle
+        cpu->total_t_cycles += (m_cycles * M) / T;
+
+        return m_cycles;
+    }
+}
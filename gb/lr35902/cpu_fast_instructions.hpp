@@ -0,0 +1,675 @@
+#pragma once
+
+#include "../macros.hpp"
+#include "../structs.hpp"
+#include "../memory_map.hpp"
+
+#include "cpu_defines.hpp"
+#include "cpu_struct.hpp"
+#include "cpu_instructions.hpp"
+
+// Instruction-level counterparts of the microcode in cpu_microcode.hpp
+// Each handler executes the whole instruction against a memory map
+// and returns the number of M cycles spent before the LAST cycle,
+// the LAST cycle itself is overlapped with the next opcode fetch
+// and accounted for by cpu_fast_step.
+//
+// Latches (x_latch, l_latch, alu_r_latch, etc.) are updated exactly
+// like the pin-level microcode does, so both cores can be swapped at
+// any instruction boundary.
+
+#define A cpu->r[7]
+#define B cpu->r[0]
+#define C cpu->r[1]
+#define D cpu->r[2]
+#define E cpu->r[3]
+#define F cpu->r[6]
+#define H cpu->r[4]
+#define L cpu->r[5]
+#define X cpu->r[cpu->x_latch]
+#define Y cpu->r[cpu->y_latch]
+#define AF (((uint16_t)A << 8) | F)
+#define BC (((uint16_t)B << 8) | C)
+#define DE (((uint16_t)D << 8) | E)
+#define HL (((uint16_t)H << 8) | L)
+#define NN (((uint16_t)cpu->h_latch << 8) | cpu->l_latch)
+#define SET_FLAGS(f) { F |= f; }
+#define CLEAR_FLAGS(f) { F &= ~f; }
+
+#define ZF 0b10000000
+#define NF 0b01000000
+#define HF 0b00100000
+#define CF 0b00010000
+
+#define RD(addr) mem_read(map, addr)
+#define WR(addr, data) mem_write(map, addr, data)
+
+namespace gb {
+    uint8_t fast_nop(cpu_t* cpu, memory_map_t* map) {
+        return 0;
+    }
+
+    // Handlers taking register operands are instantiated per opcode,
+    // so the x/y fields are compile-time constants
+    template <uint8_t op>
+    uint8_t fast_ld_r_r(cpu_t* cpu, memory_map_t* map) {
+        constexpr uint8_t x = (op >> 3) & 0x7;
+        constexpr uint8_t y = (op >> 0) & 0x7;
+
+        cpu->x_latch = x;
+        cpu->y_latch = y;
+
+        cpu->r[x] = cpu->r[y];
+
+        return 0;
+    }
+
+    template <uint8_t op>
+    uint8_t fast_ld_r_n(cpu_t* cpu, memory_map_t* map) {
+        constexpr uint8_t x = (op >> 3) & 0x7;
+
+        cpu->l_latch = RD(cpu->pc++);
+        cpu->x_latch = x;
+
+        cpu->r[x] = cpu->l_latch;
+
+        return 1;
+    }
+
+    template <uint8_t op>
+    uint8_t fast_ld_r_hl(cpu_t* cpu, memory_map_t* map) {
+        constexpr uint8_t x = (op >> 3) & 0x7;
+
+        cpu->l_latch = RD(HL);
+        cpu->x_latch = x;
+
+        cpu->r[x] = cpu->l_latch;
+
+        return 1;
+    }
+
+    template <uint8_t op>
+    uint8_t fast_ld_hl_r(cpu_t* cpu, memory_map_t* map) {
+        constexpr uint8_t x = (op >> 3) & 0x7;
+
+        cpu->x_latch = x;
+
+        WR(HL, (x == 6) ? cpu_flags(cpu) : cpu->r[x]);
+
+        return 1;
+    }
+
+    uint8_t fast_ld_hl_n(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+
+        WR(HL, cpu->l_latch);
+
+        return 2;
+    }
+
+    uint8_t fast_ld_a_bc(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(BC);
+
+        A = cpu->l_latch;
+
+        return 1;
+    }
+
+    uint8_t fast_ld_a_de(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(DE);
+
+        A = cpu->l_latch;
+
+        return 1;
+    }
+
+    uint8_t fast_ld_bc_a(cpu_t* cpu, memory_map_t* map) {
+        WR(BC, A);
+
+        return 1;
+    }
+
+    uint8_t fast_ld_de_a(cpu_t* cpu, memory_map_t* map) {
+        WR(DE, A);
+
+        return 1;
+    }
+
+    uint8_t fast_ld_a_nn(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+        cpu->h_latch = RD(cpu->pc++);
+        cpu->l_latch = RD(NN);
+
+        A = cpu->l_latch;
+
+        return 3;
+    }
+
+    uint8_t fast_ld_nn_a(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+        cpu->h_latch = RD(cpu->pc++);
+
+        WR(NN, A);
+
+        return 3;
+    }
+
+    uint8_t fast_ldh_a_c(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(0xff00 | C);
+
+        A = cpu->l_latch;
+
+        return 1;
+    }
+
+    uint8_t fast_ldh_c_a(cpu_t* cpu, memory_map_t* map) {
+        WR(0xff00 | C, A);
+
+        return 1;
+    }
+
+    uint8_t fast_ldh_a_n(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+        cpu->l_latch = RD(0xff00 | cpu->l_latch);
+
+        A = cpu->l_latch;
+
+        return 2;
+    }
+
+    uint8_t fast_ldh_n_a(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+
+        WR(0xff00 | cpu->l_latch, A);
+
+        return 2;
+    }
+
+    uint8_t fast_ld_a_hld(cpu_t* cpu, memory_map_t* map) {
+        uint16_t addr = HL;
+
+        dec_hl(cpu);
+
+        cpu->l_latch = RD(addr);
+
+        A = cpu->l_latch;
+
+        return 1;
+    }
+
+    uint8_t fast_ld_hld_a(cpu_t* cpu, memory_map_t* map) {
+        uint16_t addr = HL;
+
+        dec_hl(cpu);
+
+        WR(addr, A);
+
+        return 1;
+    }
+
+    uint8_t fast_ld_a_hli(cpu_t* cpu, memory_map_t* map) {
+        uint16_t addr = HL;
+
+        inc_hl(cpu);
+
+        cpu->l_latch = RD(addr);
+
+        A = cpu->l_latch;
+
+        return 1;
+    }
+
+    uint8_t fast_ld_hli_a(cpu_t* cpu, memory_map_t* map) {
+        uint16_t addr = HL;
+
+        inc_hl(cpu);
+
+        WR(addr, A);
+
+        return 1;
+    }
+
+    uint8_t fast_ld_rr_nn(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+        cpu->h_latch = RD(cpu->pc++);
+
+        set16[(cpu->i_latch >> 4) & 0x3](cpu, NN);
+
+        return 2;
+    }
+
+    uint8_t fast_ld_nn_sp(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+        cpu->h_latch = RD(cpu->pc++);
+
+        WR(NN, cpu->sp & 0xff);
+        WR(NN + 1, (cpu->sp >> 8) & 0xff);
+
+        return 4;
+    }
+
+    uint8_t fast_ld_sp_hl(cpu_t* cpu, memory_map_t* map) {
+        set_sp(cpu, HL);
+
+        return 1;
+    }
+
+    inline uint8_t fast_push(cpu_t* cpu, memory_map_t* map, uint8_t hi, uint8_t lo) {
+        WR(--cpu->sp, hi);
+        WR(--cpu->sp, lo);
+
+        return 3;
+    }
+
+    uint8_t fast_push_bc(cpu_t* cpu, memory_map_t* map) { return fast_push(cpu, map, B, C); }
+    uint8_t fast_push_de(cpu_t* cpu, memory_map_t* map) { return fast_push(cpu, map, D, E); }
+    uint8_t fast_push_hl(cpu_t* cpu, memory_map_t* map) { return fast_push(cpu, map, H, L); }
+    uint8_t fast_push_af(cpu_t* cpu, memory_map_t* map) { return fast_push(cpu, map, A, cpu_flags(cpu)); }
+
+    inline void fast_pop(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->sp++);
+        cpu->h_latch = RD(cpu->sp++);
+    }
+
+    uint8_t fast_pop_bc(cpu_t* cpu, memory_map_t* map) { fast_pop(cpu, map); set_bc(cpu, NN); return 2; }
+    uint8_t fast_pop_de(cpu_t* cpu, memory_map_t* map) { fast_pop(cpu, map); set_de(cpu, NN); return 2; }
+    uint8_t fast_pop_hl(cpu_t* cpu, memory_map_t* map) { fast_pop(cpu, map); set_hl(cpu, NN); return 2; }
+    uint8_t fast_pop_af(cpu_t* cpu, memory_map_t* map) { fast_pop(cpu, map); set_af(cpu, NN); return 2; }
+
+    uint8_t fast_jp_nn(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+        cpu->h_latch = RD(cpu->pc++);
+        cpu->pc = NN;
+
+        return 3;
+    }
+
+    uint8_t fast_jp_hl(cpu_t* cpu, memory_map_t* map) {
+        cpu->pc = HL;
+
+        return 0;
+    }
+
+    uint8_t fast_jp_cc_nn(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+        cpu->h_latch = RD(cpu->pc++);
+
+        if (!check_condition(cpu, (cpu->i_latch >> 3) & 0x3))
+            return 2;
+
+        cpu->pc = NN;
+
+        return 3;
+    }
+
+    uint8_t fast_jr_n(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+        cpu->pc += (int8_t)cpu->l_latch;
+
+        return 2;
+    }
+
+    uint8_t fast_jr_cc_n(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+
+        if (!check_condition(cpu, (cpu->i_latch >> 3) & 0x3))
+            return 1;
+
+        cpu->pc += (int8_t)cpu->l_latch;
+
+        return 2;
+    }
+
+    uint8_t fast_call_nn(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+        cpu->h_latch = RD(cpu->pc++);
+
+        fast_push(cpu, map, (cpu->pc >> 8) & 0xff, (cpu->pc >> 0) & 0xff);
+
+        cpu->pc = NN;
+
+        return 5;
+    }
+
+    uint8_t fast_call_cc_nn(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+        cpu->h_latch = RD(cpu->pc++);
+
+        if (!check_condition(cpu, (cpu->i_latch >> 3) & 0x3))
+            return 2;
+
+        fast_push(cpu, map, (cpu->pc >> 8) & 0xff, (cpu->pc >> 0) & 0xff);
+
+        cpu->pc = NN;
+
+        return 5;
+    }
+
+    uint8_t fast_ret(cpu_t* cpu, memory_map_t* map) {
+        fast_pop(cpu, map);
+
+        cpu->pc = NN;
+
+        return 3;
+    }
+
+    uint8_t fast_ret_cc(cpu_t* cpu, memory_map_t* map) {
+        if (!check_condition(cpu, (cpu->i_latch >> 3) & 0x3))
+            return 1;
+
+        fast_pop(cpu, map);
+
+        cpu->pc = NN;
+
+        return 4;
+    }
+
+    uint8_t fast_reti(cpu_t* cpu, memory_map_t* map) {
+        fast_pop(cpu, map);
+
+        cpu->ime = true;
+        cpu->pc = NN;
+
+        return 3;
+    }
+
+    uint8_t fast_rst_n(cpu_t* cpu, memory_map_t* map) {
+        fast_push(cpu, map, (cpu->pc >> 8) & 0xff, (cpu->pc >> 0) & 0xff);
+
+        cpu->pc = cpu->i_latch & 0x38;
+
+        return 3;
+    }
+
+    // ALU, add8/sub8/etc. are shared with the pin-level core
+
+    template <uint8_t op>
+    uint8_t fast_add_a_r(cpu_t* cpu, memory_map_t* map) {
+        constexpr uint8_t y = (op >> 0) & 0x7;
+
+        cpu->y_latch = y;
+
+        add8(cpu, &A, cpu->r[y], op & 0x8);
+
+        return 0;
+    }
+
+    uint8_t fast_add_a_n(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+
+        add8(cpu, &A, cpu->l_latch, cpu->i_latch & 0x8);
+
+        return 1;
+    }
+
+    uint8_t fast_add_a_hl(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(HL);
+
+        add8(cpu, &A, cpu->l_latch, cpu->i_latch & 0x8);
+
+        return 1;
+    }
+
+    template <uint8_t op>
+    uint8_t fast_sub_a_r(cpu_t* cpu, memory_map_t* map) {
+        constexpr uint8_t y = (op >> 0) & 0x7;
+
+        cpu->y_latch = y;
+
+        sub8(cpu, &A, cpu->r[y], op & 0x8);
+
+        return 0;
+    }
+
+    uint8_t fast_sub_a_n(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+
+        sub8(cpu, &A, cpu->l_latch, cpu->i_latch & 0x8);
+
+        return 1;
+    }
+
+    uint8_t fast_sub_a_hl(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(HL);
+
+        sub8(cpu, &A, cpu->l_latch, cpu->i_latch & 0x8);
+
+        return 1;
+    }
+
+    template <uint8_t op>
+    uint8_t fast_and_a_r(cpu_t* cpu, memory_map_t* map) {
+        constexpr uint8_t y = (op >> 0) & 0x7;
+
+        cpu->y_latch = y;
+
+        and8(cpu, &A, cpu->r[y]);
+
+        return 0;
+    }
+
+    uint8_t fast_and_a_n(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+
+        and8(cpu, &A, cpu->l_latch);
+
+        return 1;
+    }
+
+    uint8_t fast_and_a_hl(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(HL);
+
+        and8(cpu, &A, cpu->l_latch);
+
+        return 1;
+    }
+
+    template <uint8_t op>
+    uint8_t fast_xor_a_r(cpu_t* cpu, memory_map_t* map) {
+        constexpr uint8_t y = (op >> 0) & 0x7;
+
+        cpu->y_latch = y;
+
+        xor8(cpu, &A, cpu->r[y]);
+
+        return 0;
+    }
+
+    uint8_t fast_xor_a_n(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+
+        xor8(cpu, &A, cpu->l_latch);
+
+        return 1;
+    }
+
+    uint8_t fast_xor_a_hl(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(HL);
+
+        xor8(cpu, &A, cpu->l_latch);
+
+        return 1;
+    }
+
+    template <uint8_t op>
+    uint8_t fast_or_a_r(cpu_t* cpu, memory_map_t* map) {
+        constexpr uint8_t y = (op >> 0) & 0x7;
+
+        cpu->y_latch = y;
+
+        or8(cpu, &A, cpu->r[y]);
+
+        return 0;
+    }
+
+    uint8_t fast_or_a_n(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+
+        or8(cpu, &A, cpu->l_latch);
+
+        return 1;
+    }
+
+    uint8_t fast_or_a_hl(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(HL);
+
+        or8(cpu, &A, cpu->l_latch);
+
+        return 1;
+    }
+
+    template <uint8_t op>
+    uint8_t fast_cp_a_r(cpu_t* cpu, memory_map_t* map) {
+        constexpr uint8_t y = (op >> 0) & 0x7;
+
+        cpu->y_latch = y;
+
+        cp8(cpu, &A, cpu->r[y]);
+
+        return 0;
+    }
+
+    uint8_t fast_cp_a_n(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(cpu->pc++);
+
+        cp8(cpu, &A, cpu->l_latch);
+
+        return 1;
+    }
+
+    uint8_t fast_cp_a_hl(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(HL);
+
+        cp8(cpu, &A, cpu->l_latch);
+
+        return 1;
+    }
+
+    template <uint8_t op>
+    uint8_t fast_inc_r(cpu_t* cpu, memory_map_t* map) {
+        constexpr uint8_t x = (op >> 3) & 0x7;
+
+        cpu->x_latch = x;
+
+        cpu->r[x]++;
+
+        inc_dec_flags(cpu, cpu->r[x]);
+
+        return 0;
+    }
+
+    uint8_t fast_inc_dhl(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(HL);
+
+        WR(HL, ++cpu->l_latch);
+
+        cpu_flags_sync(cpu);
+
+        inc_dec_flags(cpu, cpu->r[cpu->x_latch]);
+
+        return 2;
+    }
+
+    template <uint8_t op>
+    uint8_t fast_dec_r(cpu_t* cpu, memory_map_t* map) {
+        constexpr uint8_t x = (op >> 3) & 0x7;
+
+        cpu->x_latch = x;
+
+        cpu->r[x]--;
+
+        inc_dec_flags(cpu, cpu->r[x]);
+
+        return 0;
+    }
+
+    uint8_t fast_dec_dhl(cpu_t* cpu, memory_map_t* map) {
+        cpu->l_latch = RD(HL);
+
+        WR(HL, --cpu->l_latch);
+
+        cpu_flags_sync(cpu);
+
+        inc_dec_flags(cpu, cpu->r[cpu->x_latch]);
+
+        return 2;
+    }
+
+    uint8_t fast_cpl_a(cpu_t* cpu, memory_map_t* map) {
+        A ^= 0xff;
+
+        return 0;
+    }
+
+    uint8_t fast_scf(cpu_t* cpu, memory_map_t* map) {
+        cpu_flags_sync(cpu);
+
+        SET_FLAGS(CF);
+
+        return 0;
+    }
+
+    uint8_t fast_ccf(cpu_t* cpu, memory_map_t* map) {
+        cpu_flags_sync(cpu);
+
+        CLEAR_FLAGS(CF);
+
+        return 0;
+    }
+
+    // CB page, the CB opcode fetch is done by fast_cb
+    // (cpu_fast_table.hpp)
+    template <uint8_t cb>
+    uint8_t fast_cb_op(cpu_t* cpu, memory_map_t* map) {
+        constexpr uint8_t y = (cb >> 0) & 0x7;
+
+        if constexpr (y != 6) {
+            cb_exec<cb>(cpu, &cpu->r[y]);
+
+            return 0;
+        }
+
+        cpu->l_latch = RD(HL);
+
+        cb_exec<cb>(cpu, &cpu->l_latch);
+
+        // bit b, (hl) doesn't write back
+        if constexpr ((cb & 0xc0) == 0x40) return 1;
+
+        WR(HL, cpu->l_latch);
+
+        return 2;
+    }
+
+    uint8_t fast_unk(cpu_t* cpu, memory_map_t* map) {
+        _logc(cpu, debug, "Unimplemented instruction %02x!", cpu->i_latch);
+
+        return 0;
+    }
+}
+
+#undef A
+#undef B
+#undef C
+#undef D
+#undef E
+#undef F
+#undef H
+#undef L
+#undef X
+#undef Y
+#undef AF
+#undef BC
+#undef DE
+#undef HL
+#undef NN
+#undef SET_FLAGS
+#undef CLEAR_FLAGS
+
+#undef RD
+#undef WR
+
+#undef ZF
+#undef NF
+#undef HF
+#undef CF
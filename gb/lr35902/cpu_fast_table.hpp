@@ -0,0 +1,66 @@
+#pragma once
+
+#include "../macros.hpp"
+#include "../structs.hpp"
+
+#include "cpu_fast_instructions.hpp"
+
+#include <utility>
+
+namespace gb {
+    struct fast_cb_table_t {
+        cpu_fast_instruction_t op[256];
+    };
+
+    template <size_t... cb>
+    constexpr fast_cb_table_t fast_cb_generate(std::index_sequence<cb...>) {
+        return {{ fast_cb_op<cb>... }};
+    }
+
+    constexpr fast_cb_table_t fast_cb_table = fast_cb_generate(std::make_index_sequence<256>());
+
+    uint8_t fast_cb(cpu_t* cpu, memory_map_t* map) {
+        cpu->cb_latch = mem_read(map, cpu->pc++);
+
+        return fast_cb_table.op[cpu->cb_latch](cpu, map) + 1;
+    }
+
+    // Every entry here must mirror the pin-level microcode
+    // (cpu_microcode.hpp) at the same opcode
+    static cpu_fast_instruction_t fast_instruction_table[] = {
+    /*  X0                  X1                  X2                  X3                  X4                  X5                  X6                  X7                   */
+    /*  X8                  X9                  Xa                  Xb                  Xc                  Xd                  Xe                  Xf                   */
+        fast_nop,           fast_ld_rr_nn,      fast_unk,           fast_unk,           fast_inc_r<0x04>,   fast_dec_r<0x05>,   fast_ld_r_n<0x06>,  fast_unk,           /* 0X */
+        fast_ld_nn_sp,      fast_unk,           fast_ld_a_bc,       fast_unk,           fast_inc_r<0x0c>,   fast_dec_r<0x0d>,   fast_ld_r_n<0x0e>,  fast_unk,
+        fast_unk,           fast_ld_rr_nn,      fast_unk,           fast_unk,           fast_inc_r<0x14>,   fast_dec_r<0x15>,   fast_ld_r_n<0x16>,  fast_unk,           /* 1X */
+        fast_jr_n,          fast_unk,           fast_ld_a_de,       fast_unk,           fast_inc_r<0x1c>,   fast_dec_r<0x1d>,   fast_ld_r_n<0x1e>,  fast_unk,
+        fast_jr_cc_n,       fast_ld_rr_nn,      fast_ld_hli_a,      fast_unk,           fast_inc_r<0x24>,   fast_dec_r<0x25>,   fast_ld_r_n<0x26>,  fast_unk,           /* 2X */
+        fast_jr_cc_n,       fast_unk,           fast_ld_a_hli,      fast_unk,           fast_inc_r<0x2c>,   fast_dec_r<0x2d>,   fast_ld_r_n<0x2e>,  fast_cpl_a,
+        fast_jr_cc_n,       fast_ld_rr_nn,      fast_ld_hld_a,      fast_unk,           fast_inc_dhl,       fast_dec_dhl,       fast_ld_hl_n,       fast_scf,           /* 3X */
+        fast_jr_cc_n,       fast_unk,           fast_ld_a_hld,      fast_unk,           fast_inc_r<0x3c>,   fast_dec_r<0x3d>,   fast_ld_r_n<0x3e>,  fast_ccf,
+        fast_ld_r_r<0x40>,  fast_ld_r_r<0x41>,  fast_ld_r_r<0x42>,  fast_ld_r_r<0x43>,  fast_ld_r_r<0x44>,  fast_ld_r_r<0x45>,  fast_ld_r_hl<0x46>, fast_ld_r_r<0x47>,  /* 4X */
+        fast_ld_r_r<0x48>,  fast_ld_r_r<0x49>,  fast_ld_r_r<0x4a>,  fast_ld_r_r<0x4b>,  fast_ld_r_r<0x4c>,  fast_ld_r_r<0x4d>,  fast_ld_r_hl<0x4e>, fast_ld_r_r<0x4f>,
+        fast_ld_r_r<0x50>,  fast_ld_r_r<0x51>,  fast_ld_r_r<0x52>,  fast_ld_r_r<0x53>,  fast_ld_r_r<0x54>,  fast_ld_r_r<0x55>,  fast_ld_r_hl<0x56>, fast_ld_r_r<0x57>,  /* 5X */
+        fast_ld_r_r<0x58>,  fast_ld_r_r<0x59>,  fast_ld_r_r<0x5a>,  fast_ld_r_r<0x5b>,  fast_ld_r_r<0x5c>,  fast_ld_r_r<0x5d>,  fast_ld_r_hl<0x5e>, fast_ld_r_r<0x5f>,
+        fast_ld_r_r<0x60>,  fast_ld_r_r<0x61>,  fast_ld_r_r<0x62>,  fast_ld_r_r<0x63>,  fast_ld_r_r<0x64>,  fast_ld_r_r<0x65>,  fast_ld_r_hl<0x66>, fast_ld_r_r<0x67>,  /* 6X */
+        fast_ld_r_r<0x68>,  fast_ld_r_r<0x69>,  fast_ld_r_r<0x6a>,  fast_ld_r_r<0x6b>,  fast_ld_r_r<0x6c>,  fast_ld_r_r<0x6d>,  fast_ld_r_hl<0x6e>, fast_ld_r_r<0x6f>,
+        fast_ld_hl_r<0x70>, fast_ld_hl_r<0x71>, fast_ld_hl_r<0x72>, fast_ld_hl_r<0x73>, fast_ld_hl_r<0x74>, fast_ld_hl_r<0x75>, fast_unk,           fast_ld_hl_r<0x77>, /* 7X */
+        fast_ld_r_r<0x78>,  fast_ld_r_r<0x79>,  fast_ld_r_r<0x7a>,  fast_ld_r_r<0x7b>,  fast_ld_r_r<0x7c>,  fast_ld_r_r<0x7d>,  fast_ld_r_hl<0x7e>, fast_ld_r_r<0x7f>,
+        fast_add_a_r<0x80>, fast_add_a_r<0x81>, fast_add_a_r<0x82>, fast_add_a_r<0x83>, fast_add_a_r<0x84>, fast_add_a_r<0x85>, fast_add_a_hl,      fast_add_a_r<0x87>, /* 8X */
+        fast_add_a_r<0x88>, fast_add_a_r<0x89>, fast_add_a_r<0x8a>, fast_add_a_r<0x8b>, fast_add_a_r<0x8c>, fast_add_a_r<0x8d>, fast_add_a_hl,      fast_add_a_r<0x8f>,
+        fast_sub_a_r<0x90>, fast_sub_a_r<0x91>, fast_sub_a_r<0x92>, fast_sub_a_r<0x93>, fast_sub_a_r<0x94>, fast_sub_a_r<0x95>, fast_sub_a_hl,      fast_sub_a_r<0x97>, /* 9X */
+        fast_sub_a_r<0x98>, fast_sub_a_r<0x99>, fast_sub_a_r<0x9a>, fast_sub_a_r<0x9b>, fast_sub_a_r<0x9c>, fast_sub_a_r<0x9d>, fast_sub_a_hl,      fast_sub_a_r<0x9f>,
+        fast_and_a_r<0xa0>, fast_and_a_r<0xa1>, fast_and_a_r<0xa2>, fast_and_a_r<0xa3>, fast_and_a_r<0xa4>, fast_and_a_r<0xa5>, fast_and_a_hl,      fast_and_a_r<0xa7>, /* aX */
+        fast_or_a_r<0xa8>,  fast_or_a_r<0xa9>,  fast_or_a_r<0xaa>,  fast_or_a_r<0xab>,  fast_or_a_r<0xac>,  fast_or_a_r<0xad>,  fast_or_a_hl,       fast_or_a_r<0xaf>,
+        fast_xor_a_r<0xb0>, fast_xor_a_r<0xb1>, fast_xor_a_r<0xb2>, fast_xor_a_r<0xb3>, fast_xor_a_r<0xb4>, fast_xor_a_r<0xb5>, fast_xor_a_hl,      fast_xor_a_r<0xb7>, /* bX */
+        fast_cp_a_r<0xb8>,  fast_cp_a_r<0xb9>,  fast_cp_a_r<0xba>,  fast_cp_a_r<0xbb>,  fast_cp_a_r<0xbc>,  fast_cp_a_r<0xbd>,  fast_cp_a_hl,       fast_cp_a_r<0xbf>,
+        fast_ret_cc,        fast_pop_bc,        fast_jp_cc_nn,      fast_jp_nn,         fast_call_cc_nn,    fast_push_bc,       fast_add_a_n,       fast_rst_n,         /* cX */
+        fast_ret_cc,        fast_ret,           fast_jp_cc_nn,      fast_cb,            fast_call_cc_nn,    fast_call_nn,       fast_add_a_n,       fast_rst_n,
+        fast_ret_cc,        fast_pop_de,        fast_jp_cc_nn,      fast_unk,           fast_call_cc_nn,    fast_push_de,       fast_sub_a_n,       fast_rst_n,         /* dX */
+        fast_ret_cc,        fast_reti,          fast_jp_cc_nn,      fast_unk,           fast_call_cc_nn,    fast_unk,           fast_sub_a_n,       fast_rst_n,
+        fast_ldh_n_a,       fast_pop_hl,        fast_ldh_c_a,       fast_unk,           fast_unk,           fast_push_hl,       fast_and_a_n,       fast_rst_n,         /* eX */
+        fast_unk,           fast_jp_hl,         fast_ld_nn_a,       fast_unk,           fast_unk,           fast_unk,           fast_or_a_n,        fast_rst_n,
+        fast_ldh_a_n,       fast_pop_af,        fast_ldh_a_c,       fast_unk,           fast_unk,           fast_push_af,       fast_xor_a_n,       fast_rst_n,         /* fX */
+        fast_unk,           fast_ld_sp_hl,      fast_ld_a_nn,       fast_unk,           fast_unk,           fast_unk,           fast_cp_a_n,        fast_rst_n
+    };
+}
\ No newline at end of file
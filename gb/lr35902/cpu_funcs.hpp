@@ -7,8 +7,8 @@
 #include "lr35902_struct.hpp"
 
 #include "cpu_instructions.hpp"
+#include "cpu_microcode.hpp"
 #include "cpu_struct.hpp"
-#include "cpu_table.hpp"
 #include "cpu_bus.hpp"
 
 namespace gb {
@@ -17,36 +17,179 @@ namespace gb {
         std::memset(cpu, 0, sizeof(cpu_t));
 
         // Initialize bus to idle state
-        cpu->bus.rd = true;
-        cpu->bus.wr = true;
-        cpu->bus.a = 0x8000;
-        cpu->bus.cs = true;
+        cpu->bus.pins = bus_pins(0x8000, 0x00, true, true, true);
 
         cpu->main_bus_set = &lr35902->main_bus_set;
         cpu->vram_bus_set = &lr35902->vram_bus_set;
+        cpu->boot = &lr35902->boot;
         cpu->state = ST_FETCH;
+        cpu->resume = RS_FETCH;
+    }
+
+    // Resume point matching the CPU's current state, needed whenever
+    // the state is changed outside of cpu_clock
+    uint8_t cpu_resume_point(cpu_t* cpu) {
+        switch (cpu->state) {
+            case ST_FETCH: return RS_FETCH;
+            case ST_EXECUTE_FETCH: return RS_PREFETCH;
+            case ST_EXECUTE: break;
+            default: return RS_NONE;
+        }
+
+        if (cpu->read_ongoing) return RS_READ;
+        if (cpu->write_ongoing) return RS_WRITE;
+        if (cpu->idle_cycle) return RS_IDLE;
+
+        return RS_HANDLER;
     }
 
     bool cpu_bus_is_read(cpu_t* cpu) {
-        return (!cpu->bus.rd) && cpu->bus.wr;
+        return (cpu->bus.pins & (BUS_RD | BUS_WR)) == BUS_WR;
     }
 
     bool cpu_bus_is_write(cpu_t* cpu) {
-        return (!cpu->bus.wr) && cpu->bus.rd;
+        return (cpu->bus.pins & (BUS_RD | BUS_WR)) == BUS_RD;
     }
 
-    void cpu_update_clocks(cpu_t* cpu) {
-        cpu->ck_half_cycle++;
-        cpu->ck_half_cycle %= 8;
+    // Clocks are derived from the master timestamp (in half
+    // cycles) rather than counted, so the CPU doesn't need
+    // to be clocked on half cycles where nothing happens
+    void cpu_update_clocks(cpu_t* cpu, uint64_t now) {
+        cpu->ck_half_cycle = now & (M - 1);
+        cpu->total_t_cycles = now / T;
 
-        if (!(cpu->ck_half_cycle % 2)) {
-            cpu->total_t_cycles++;
+        // cpu->bus.phi = !((cpu->ck_half_cycle >> 2) & 1);
+    }
+
+    // Number of upcoming half cycles on which the CPU wouldn't
+    // touch its pins or latches, and can safely be skipped:
+    // Reads only act on ck=0,1,2,6,7
+    // Writes only act on ck=0,1,2,3,6,7
+    // Idle cycles only act on ck=0,7
+    uint8_t cpu_skippable_half_cycles(cpu_t* cpu) {
+        uint8_t ck = cpu->ck_half_cycle;
+
+        if (cpu->state == ST_TEST)
+            return 0;
+
+        if (cpu->read_ongoing) {
+            if (ck >= 3 && ck < 6) return 6 - ck;
+        } else if (cpu->write_ongoing) {
+            if (ck >= 4 && ck < 6) return 6 - ck;
+        } else if (cpu->idle_cycle) {
+            if (ck >= 1 && ck < 7) return 7 - ck;
         }
 
-        // cpu->bus.phi = !((cpu->ck_half_cycle >> 2) & 1);
+        return 0;
     }
 
-    void cpu_clock(cpu_t* cpu) {
+    // Opcode fetch overlapped with an instruction's LAST cycle,
+    // the instruction itself already ran on the first half cycle
+    inline void cpu_prefetch(cpu_t* cpu) {
+        if (!cpu->read_ongoing) {
+            cpu_init_read(cpu, cpu->pc++);
+        }
+
+        if (!cpu_handle_read(cpu, &cpu->temp_i_latch)) {
+            cpu->i_latch = cpu->temp_i_latch;
+            cpu->ex_m_cycle = 0;
+            cpu->state = ST_EXECUTE;
+        }
+    }
+
+#ifdef GB_THREADED_DISPATCH
+#if !defined(__GNUC__) && !defined(__clang__)
+#error "Threaded dispatch needs computed goto (GCC or Clang)"
+#endif
+
+    // Threaded dispatch: instead of switching on the state and calling
+    // into the instruction handler every half cycle, jump straight to
+    // the code for the saved resume point and the current half cycle.
+    // Handlers are only entered where they have something to do:
+    // starting an M cycle, latching read data and finishing a
+    // transaction. Everything in between is just bus pins.
+    //
+    // Only the resume point index lives in cpu_t, label addresses
+    // never leave this function, so save states don't depend on
+    // which engine (or which run) wrote them.
+    void cpu_clock(cpu_t* cpu, uint64_t now) {
+        static void* const dispatch[RS_COUNT][8] = {
+            // RS_HANDLER
+            { &&handler, &&handler, &&handler, &&handler, &&handler, &&handler, &&handler, &&handler },
+
+            // RS_READ
+            { &&handler, &&read_pins, &&read_pins, &&wait, &&wait, &&wait, &&handler, &&handler },
+
+            // RS_WRITE
+            { &&handler, &&write_pins, &&write_pins, &&write_pins, &&wait, &&wait, &&write_pins, &&handler },
+
+            // RS_IDLE
+            { &&handler, &&wait, &&wait, &&wait, &&wait, &&wait, &&wait, &&handler },
+
+            // RS_FETCH
+            { &&fetch, &&read_pins, &&read_pins, &&wait, &&wait, &&wait, &&fetch_latch, &&fetch_end },
+
+            // RS_PREFETCH
+            { &&prefetch, &&read_pins, &&read_pins, &&wait, &&wait, &&wait, &&prefetch_latch, &&prefetch_end },
+
+            // RS_NONE
+            { &&wait, &&wait, &&wait, &&wait, &&wait, &&wait, &&wait, &&wait }
+        };
+
+        cpu_update_clocks(cpu, now);
+
+        goto *dispatch[cpu->resume][cpu->ck_half_cycle];
+
+        handler: {
+            instruction_state_t state = cpu_microcode_exec(cpu);
+
+            if (state == IS_LAST_CYCLE) {
+                cpu->state = ST_EXECUTE_FETCH;
+
+                cpu_prefetch(cpu);
+            }
+
+            cpu->resume = cpu_resume_point(cpu);
+        } goto done;
+
+        fetch: {
+            cpu_init_read(cpu, cpu->pc++);
+            cpu_bus_drive(cpu, BA_READ);
+        } goto done;
+
+        prefetch: {
+            cpu_prefetch(cpu);
+        } goto done;
+
+        read_pins: cpu_bus_drive(cpu, BA_READ); goto done;
+        write_pins: cpu_bus_drive(cpu, BA_WRITE); goto done;
+
+        fetch_latch: cpu->i_latch = bus_d(&cpu->bus); goto done;
+        prefetch_latch: cpu->temp_i_latch = bus_d(&cpu->bus); goto done;
+
+        fetch_end: {
+            cpu->read_ongoing = false;
+            cpu->state = ST_EXECUTE;
+            cpu->resume = RS_HANDLER;
+        } goto done;
+
+        prefetch_end: {
+            cpu->read_ongoing = false;
+            cpu->i_latch = cpu->temp_i_latch;
+            cpu->ex_m_cycle = 0;
+            cpu->state = ST_EXECUTE;
+            cpu->resume = RS_HANDLER;
+        } goto done;
+
+        wait:
+        done:
+        cpu_update_clocks(cpu, now + 1);
+    }
+#else
+    // Clock the half cycle at timestamp `now`
+    void cpu_clock(cpu_t* cpu, uint64_t now) {
+        cpu_update_clocks(cpu, now);
+
         switch (cpu->state) {
             case ST_FETCH: {
                 if (!cpu->read_ongoing) {
@@ -59,25 +202,24 @@ namespace gb {
             } break;
 
             case ST_EXECUTE: {
-                instruction_state_t state = instruction_table[cpu->i_latch](cpu);
+                instruction_state_t state = cpu_microcode_exec(cpu);
 
-                // Emulate prefetch
+                // Emulate prefetch, the instruction's LAST cycle
+                // work only runs once, the rest of the M cycle is
+                // just the fetch
                 if (state == IS_LAST_CYCLE) {
-                    if (!cpu->read_ongoing) {
-                        cpu_init_read(cpu, cpu->pc++);
-                    }
-
-                    if (!cpu_handle_read(cpu, &cpu->temp_i_latch)) {
-                        cpu->i_latch = cpu->temp_i_latch;
-                        cpu->ex_m_cycle = 0;
-                        cpu->state = ST_EXECUTE;
-                    }
+                    cpu->state = ST_EXECUTE_FETCH;
+
+                    cpu_prefetch(cpu);
                 }
             } break;
 
+            case ST_EXECUTE_FETCH: cpu_prefetch(cpu); break;
+
             case ST_TEST: { /* CPU is externally controlled */ } break;
         }
 
-        cpu_update_clocks(cpu);
+        cpu_update_clocks(cpu, now + 1);
     }
-}
\ No newline at end of file
+#endif
+}
@@ -9,6 +9,9 @@
 
 #include <cassert>
 
+// Register and ALU helpers, shared by the microcode interpreter
+// (cpu_microcode.hpp) and the fast core
+
 // Use (void) to silence unused warnings.
 #define assertm(exp, msg) assert(((void)msg, exp))
 
@@ -35,60 +38,107 @@
 #define HF 0b00100000
 #define CF 0b00010000
 
-#define INVALID_M \
-    default: { \
-        _log(error, "Invalid M cycle %u while executing %s", cpu->ex_m_cycle, __FUNCTION__); \
-        std::exit(1); \
-    } break;
-
-#define WRITE(cycle, addr, data, init, fini) \
-    case cycle: { \
-        if (!cpu->write_ongoing) { \
-            cpu_init_write(cpu, addr, data); \
-            init; \
-        } \
-        if (!cpu_handle_write(cpu)) { \
-            cpu->ex_m_cycle++; \
-            fini;  \
-        } \
-        return IS_EXECUTING; \
-    } break; \
-
-#define READ(cycle, addr, dest, init, fini) \
-    case cycle: { \
-        if (!cpu->read_ongoing) { \
-            cpu_init_read(cpu, addr); \
-            init; \
-        } \
-        if (!cpu_handle_read(cpu, dest)) { \
-            cpu->ex_m_cycle++; \
-            fini;  \
-        } \
-        return IS_EXECUTING; \
-    } break; \
-
-#define IDLE(cycle, init, fini) \
-    case cycle: { \
-        if (!cpu->idle_cycle) { \
-            cpu_init_idle(cpu); \
-            init; \
-        } \
-        if (!cpu_handle_idle(cpu)) { \
-            cpu->ex_m_cycle++; \
-            fini;  \
-        } \
-        return IS_EXECUTING; \
-    } break; \
-
-#define LAST(cycle, exec) \
-    case cycle: { \
-        if (!cpu->read_ongoing) { \
-            exec; \
-        } \
-        return IS_LAST_CYCLE; \
-    } break;
-
 namespace gb {
+    // Flags
+    //
+    // Every flag-setting ALU op goes through alu_flags. By default F is
+    // updated right away, with GB_LAZY_FLAGS only the op, its operands
+    // and result are recorded and F is worked out when something reads
+    // it (conditions, carry-in, push af, snapshots...). Both go through
+    // alu_flags_compute, so results are identical.
+    //
+    // While an op is pending, r[6] is stale for the bits that op sets,
+    // anything touching r[6] directly must call cpu_flags_sync first.
+
+    // Flags each op sets, everything else is left as it was
+    constexpr uint8_t alu_flags_mask[] = {
+        0,                      // ALU_NONE
+        ZF | NF | HF | CF,      // ALU_ADD
+        ZF | NF | CF,           // ALU_SUB
+        ZF | NF | HF,           // ALU_AND
+        ZF | NF,                // ALU_OR
+        ZF | NF | HF,           // ALU_INC
+        ZF | NF | HF | CF       // ALU_SET
+    };
+
+    // Note and/or/xor only ever clear N, their CLEAR_FLAGS(NF | CF ...)
+    // used to expand to F &= ~NF | CF ..., and sub/cp never set C
+    // (the result is signed). Both quirks are kept as they were.
+    inline uint8_t alu_flags_compute(uint8_t f, uint8_t op, uint8_t a, uint8_t b, int16_t r) {
+        switch (op) {
+            case ALU_ADD: {
+                f &= ~(ZF | NF | HF | CF);
+
+                if (r > 0xff) f |= CF;
+                if (((a & 0xf) + (b & 0xf)) & 0xf0) f |= HF;
+            } break;
+
+            case ALU_SUB: {
+                f &= ~(ZF | CF);
+                f |= NF;
+
+                if (r > 0xff) f |= CF;
+            } break;
+
+            case ALU_AND: {
+                f &= ~(ZF | NF);
+                f |= HF;
+            } break;
+
+            case ALU_OR: {
+                f &= ~(ZF | NF);
+            } break;
+
+            case ALU_INC: {
+                f &= ~(ZF | NF | HF);
+
+                if (((r & 0xf) + 1) & 0xf0) f |= HF;
+            } break;
+
+            case ALU_SET: return (f & ~(ZF | NF | HF | CF)) | (b & 0xf0);
+
+            default: return f;
+        }
+
+        if (!(r & 0xff)) f |= ZF;
+
+        return f;
+    }
+
+    // Current value of F
+    inline uint8_t cpu_flags(cpu_t* cpu) {
+#ifdef GB_LAZY_FLAGS
+        return alu_flags_compute(F, cpu->alu_op, cpu->alu_a, cpu->alu_b, cpu->alu_r);
+#else
+        return F;
+#endif
+    }
+
+    // Bring r[6] up to date
+    inline void cpu_flags_sync(cpu_t* cpu) {
+#ifdef GB_LAZY_FLAGS
+        F = cpu_flags(cpu);
+
+        cpu->alu_op = ALU_NONE;
+#endif
+    }
+
+    inline void alu_flags(cpu_t* cpu, uint8_t op, uint8_t a, uint8_t b, int16_t r) {
+#ifdef GB_LAZY_FLAGS
+        // The pending op can only be dropped if this one
+        // sets every flag it did
+        if (alu_flags_mask[cpu->alu_op] & ~alu_flags_mask[op])
+            cpu_flags_sync(cpu);
+
+        cpu->alu_op = op;
+        cpu->alu_a = a;
+        cpu->alu_b = b;
+        cpu->alu_r = r;
+#else
+        F = alu_flags_compute(F, op, a, b, r);
+#endif
+    }
+
     inline void dec_hl(cpu_t* cpu) {
         uint16_t hl = HL - 1;
 
@@ -119,6 +169,8 @@ namespace gb {
     }
 
     inline void set_af(cpu_t* cpu, uint16_t value) {
+        cpu_flags_sync(cpu);
+
         A = (value >> 8) & 0xff;
         F = (value >> 0) & 0xf0;
     }
@@ -144,7 +196,7 @@ namespace gb {
     }
 
     inline uint16_t get_af(cpu_t* cpu) {
-        return AF;
+        return ((uint16_t)A << 8) | cpu_flags(cpu);
     }
 
     typedef void (*set16_fn_t)(cpu_t*, uint16_t);
@@ -163,613 +215,27 @@ namespace gb {
     };
 
     inline bool check_condition(cpu_t* cpu, uint8_t cc) {
+        uint8_t f = cpu_flags(cpu);
+
         switch (cc) {
-            case 0: return !(cpu->r[6] & ZF);
-            case 1: return  (cpu->r[6] & ZF);
-            case 2: return !(cpu->r[6] & CF);
-            case 3: return  (cpu->r[6] & CF);
+            case 0: return !(f & ZF);
+            case 1: return  (f & ZF);
+            case 2: return !(f & CF);
+            case 3: return  (f & CF);
         }
 
         return false;
     }
 
-    instruction_state_t nop(cpu_t* cpu) {
-        return IS_LAST_CYCLE;
-    }
-
-    instruction_state_t ld_r_r(cpu_t* cpu) {
-        // 01xxxyyy
-        cpu->x_latch = (cpu->i_latch >> 3) & 0x7;
-        cpu->y_latch = (cpu->i_latch >> 0) & 0x7;
-
-        X = Y;
-
-        return IS_LAST_CYCLE;
-    }
-
-    instruction_state_t ld_r_n(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            LAST(1, cpu->x_latch = (cpu->i_latch >> 3) & 0x7; X = cpu->l_latch;);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ld_r_hl(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, HL, &cpu->l_latch, , );
-            LAST(1, cpu->x_latch = (cpu->i_latch >> 3) & 0x7; X = cpu->l_latch;);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ld_hl_r(cpu_t* cpu) {
-        cpu->x_latch = (cpu->i_latch >> 3) & 0x7;
-
-        switch (cpu->ex_m_cycle) {
-            WRITE(0, HL, X, , );
-            LAST(1, );
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ld_hl_n(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            WRITE(1, HL, cpu->l_latch, , );
-            LAST(2, );
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ld_a_bc(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, BC, &cpu->l_latch, , );
-            LAST(1, A = cpu->l_latch);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ld_a_de(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, DE, &cpu->l_latch, , );
-            LAST(1, A = cpu->l_latch);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ld_bc_a(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            WRITE(0, BC, A, , );
-            LAST(1, );
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ld_de_a(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            WRITE(0, DE, A, , );
-            LAST(1, );
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ld_a_nn(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            READ(1, cpu->pc++, &cpu->h_latch, , );
-            READ(2, NN, &cpu->l_latch, , );
-            LAST(3, A = cpu->l_latch);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ld_nn_a(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            READ(1, cpu->pc++, &cpu->h_latch, , );
-            WRITE(2, NN, A, , );
-            LAST(3, );
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ldh_a_c(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, 0xff00 | C, &cpu->l_latch, , );
-            LAST(1, A = cpu->l_latch);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ldh_c_a(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            WRITE(0, 0xff00 | C, A, , );
-            LAST(1, );
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ldh_a_n(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            READ(1, 0xff00 | cpu->l_latch, &cpu->l_latch, , );
-            LAST(2, A = cpu->l_latch);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ldh_n_a(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            WRITE(1, 0xff00 | cpu->l_latch, A, , );
-            LAST(2, );
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ld_a_hld(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, HL, &cpu->l_latch, dec_hl(cpu), );
-            LAST(1, A = cpu->l_latch);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ld_hld_a(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            WRITE(0, HL, A, dec_hl(cpu), );
-            LAST(1, );
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ld_a_hli(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, HL, &cpu->l_latch, inc_hl(cpu), );
-            LAST(1, A = cpu->l_latch);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ld_hli_a(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            WRITE(0, HL, A, inc_hl(cpu), );
-            LAST(1, );
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ld_rr_nn(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            READ(1, cpu->pc++, &cpu->h_latch, , );
-
-            case 2: {
-                set16[(cpu->i_latch >> 4) & 0x3](cpu, NN);
-
-                return IS_LAST_CYCLE;
-            } break;
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ld_nn_sp(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            READ(1, cpu->pc++, &cpu->h_latch, , );
-            WRITE(2, NN, cpu->sp & 0xff, , );
-            WRITE(3, NN + 1, (cpu->sp >> 8) & 0xff, , );
-            LAST(4, );
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ld_sp_hl(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            IDLE(0, , set_sp(cpu, HL));
-            LAST(1, );
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t push_bc(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            // push rr's first cycle is bus idle
-            // but SP is latched onto the address bus
-            IDLE(0, cpu->bus.a |= cpu->sp & 0x7fff, );
-            WRITE(1, --cpu->sp, B, , );
-            WRITE(2, --cpu->sp, C, , );
-            LAST(3, );
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t push_de(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            // push rr's first cycle is bus idle
-            // but SP is latched onto the address bus
-            IDLE(0, cpu->bus.a |= cpu->sp & 0x7fff, );
-            WRITE(1, --cpu->sp, D, , );
-            WRITE(2, --cpu->sp, E, , );
-            LAST(3, );
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t push_hl(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            // push rr's first cycle is bus idle
-            // but SP is latched onto the address bus
-            IDLE(0, cpu->bus.a |= cpu->sp & 0x7fff, );
-            WRITE(1, --cpu->sp, H, , );
-            WRITE(2, --cpu->sp, L, , );
-            LAST(3, );
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t push_af(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            // push rr's first cycle is bus idle
-            // but SP is latched onto the address bus
-            IDLE(0, cpu->bus.a |= cpu->sp & 0x7fff, );
-            WRITE(1, --cpu->sp, A, , );
-            WRITE(2, --cpu->sp, F, , );
-            LAST(3, );
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t pop_bc(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->sp++, &cpu->l_latch, , );
-            READ(1, cpu->sp++, &cpu->h_latch, , );
-            LAST(2, set_bc(cpu, NN));
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t pop_de(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->sp++, &cpu->l_latch, , );
-            READ(1, cpu->sp++, &cpu->h_latch, , );
-            LAST(2, set_de(cpu, NN));
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t pop_hl(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->sp++, &cpu->l_latch, , );
-            READ(1, cpu->sp++, &cpu->h_latch, , );
-            LAST(2, set_hl(cpu, NN));
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t pop_af(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->sp++, &cpu->l_latch, , );
-            READ(1, cpu->sp++, &cpu->h_latch, , );
-            LAST(2, set_af(cpu, NN));
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t jp_nn(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            READ(1, cpu->pc++, &cpu->h_latch, , );
-            IDLE(2, , );
-            LAST(3, cpu->pc = NN);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t jp_hl(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            LAST(0, cpu->pc = HL);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t jp_cc_nn(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            READ(1, cpu->pc++, &cpu->h_latch, , );
-            
-            case 2: {
-                if (check_condition(cpu, (cpu->i_latch >> 3) & 0x3)) {
-                    if (!cpu->idle_cycle) {
-                        cpu_init_idle(cpu);
-                    }
-
-                    if (!cpu_handle_idle(cpu)) {
-                        cpu->ex_m_cycle++;
-                    }
-
-                    return IS_EXECUTING;
-                } else {
-                    return IS_LAST_CYCLE;
-                }
-            } break;
-
-            LAST(3, cpu->pc = NN);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t jr_n(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            IDLE(1, , );
-            LAST(2, cpu->pc += (int8_t)cpu->l_latch);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t jr_cc_n(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            
-            case 1: {
-                if (check_condition(cpu, (cpu->i_latch >> 3) & 0x3)) {
-                    if (!cpu->idle_cycle) {
-                        cpu_init_idle(cpu);
-                    }
-
-                    if (!cpu_handle_idle(cpu)) {
-                        cpu->ex_m_cycle++;
-                    }
-
-                    return IS_EXECUTING;
-                } else {
-                    return IS_LAST_CYCLE;
-                }
-            } break;
-
-            LAST(2, cpu->pc += (int8_t)cpu->l_latch);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t call_nn(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            READ(1, cpu->pc++, &cpu->h_latch, , );
-
-            // Basically the same as push rr, but with PC
-            IDLE(2, cpu->bus.a |= cpu->sp & 0x7fff, );
-            WRITE(3, --cpu->sp, (cpu->pc >> 8) & 0xff, , );
-            WRITE(4, --cpu->sp, (cpu->pc >> 0) & 0xff, , );
-            LAST(5, cpu->pc = NN);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t call_cc_nn(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            READ(1, cpu->pc++, &cpu->h_latch, , );
-
-            case 2: {
-                if (check_condition(cpu, (cpu->i_latch >> 3) & 0x3)) {
-                    if (!cpu->idle_cycle) {
-                        cpu_init_idle(cpu);
-
-                        // Put SP on the bus while bus-idling
-                        cpu->bus.a |= cpu->sp & 0x7fff;
-                    }
-
-                    if (!cpu_handle_idle(cpu)) {
-                        cpu->ex_m_cycle++;
-                    }
-
-                    return IS_EXECUTING;
-                } else {
-                    return IS_LAST_CYCLE;
-                }
-            } break;
-
-            WRITE(3, --cpu->sp, (cpu->pc >> 8) & 0xff, , );
-            WRITE(4, --cpu->sp, (cpu->pc >> 0) & 0xff, , );
-            LAST(5, cpu->pc = NN);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ret(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->sp++, &cpu->l_latch, , );
-            READ(1, cpu->sp++, &cpu->h_latch, , );
-            IDLE(2, , );
-            LAST(3, cpu->pc = NN);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t ret_cc(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            IDLE(0, , );
-
-            case 1: {
-                if (check_condition(cpu, (cpu->i_latch >> 3) & 0x3)) {
-                    if (!cpu->read_ongoing) {
-                        cpu_init_read(cpu, cpu->sp++);
-                    }
-
-                    if (!cpu_handle_read(cpu, &cpu->l_latch)) {
-                        cpu->ex_m_cycle++;
-                    }
-
-                    return IS_EXECUTING;
-                } else {
-                    return IS_LAST_CYCLE;
-                }
-            } break;
-
-            READ(2, cpu->sp++, &cpu->h_latch, , );
-            IDLE(3, , );
-            LAST(4, cpu->pc = NN);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
-    instruction_state_t reti(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->sp++, &cpu->l_latch, , );
-            READ(1, cpu->sp++, &cpu->h_latch, , );
-            IDLE(2, , cpu->ime = true);
-            LAST(3, cpu->pc = NN);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-    
-    instruction_state_t rst_n(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            // Basically the same as push rr, but with PC
-            IDLE(0, cpu->bus.a |= cpu->sp & 0x7fff, );
-            WRITE(1, --cpu->sp, (cpu->pc >> 8) & 0xff, , );
-            WRITE(2, --cpu->sp, (cpu->pc >> 0) & 0xff, , );
-            LAST(3, cpu->pc = cpu->i_latch & 0x38);
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-
     // ALU
 
     void add8(cpu_t* cpu, uint8_t* dest, uint8_t src, bool carry) {
         cpu->alu_r_latch = *dest;
         cpu->alu_r_latch += src;
 
-        if (carry && (F & CF)) cpu->alu_r_latch++; 
-
-        CLEAR_FLAGS(NF);
+        if (carry && (cpu_flags(cpu) & CF)) cpu->alu_r_latch++; 
 
-        if (  cpu->alu_r_latch > 0xff ) SET_FLAGS(CF) else CLEAR_FLAGS(CF);
-        if (!(cpu->alu_r_latch & 0xff)) SET_FLAGS(ZF) else CLEAR_FLAGS(ZF);
-        if (((*dest & 0xf) + (src & 0xf)) & 0xf0) SET_FLAGS(HF) else CLEAR_FLAGS(HF);
+        alu_flags(cpu, ALU_ADD, *dest, src, cpu->alu_r_latch);
 
         *dest = cpu->alu_r_latch & 0xff;
     }
@@ -778,13 +244,10 @@ namespace gb {
         cpu->alu_r_latch = *dest;
         cpu->alu_r_latch -= src;
 
-        if (carry && (F & CF)) cpu->alu_r_latch--; 
+        if (carry && (cpu_flags(cpu) & CF)) cpu->alu_r_latch--; 
 
-        SET_FLAGS(NF);
-
-        if (  cpu->alu_r_latch > 0xff ) SET_FLAGS(CF) else CLEAR_FLAGS(CF);
-        if (!(cpu->alu_r_latch & 0xff)) SET_FLAGS(ZF) else CLEAR_FLAGS(ZF);
         //if (((*dest & 0xf) + (src & 0xf)) & 0xf0) SET_FLAGS(HF) else CLEAR_FLAGS(HF);
+        alu_flags(cpu, ALU_SUB, *dest, src, cpu->alu_r_latch);
 
         *dest = cpu->alu_r_latch & 0xff;
     }
@@ -792,10 +255,7 @@ namespace gb {
     void and8(cpu_t* cpu, uint8_t* dest, uint8_t src) {
         cpu->alu_r_latch = (*dest) & src;
 
-        SET_FLAGS(HF);
-        CLEAR_FLAGS(NF | CF);
-
-        if (!(cpu->alu_r_latch & 0xff)) SET_FLAGS(ZF) else CLEAR_FLAGS(ZF);
+        alu_flags(cpu, ALU_AND, *dest, src, cpu->alu_r_latch);
 
         *dest = cpu->alu_r_latch;
     }
@@ -803,9 +263,7 @@ namespace gb {
     void xor8(cpu_t* cpu, uint8_t* dest, uint8_t src) {
         cpu->alu_r_latch = (*dest) ^ src;
 
-        CLEAR_FLAGS(NF | CF | HF);
-
-        if (!(cpu->alu_r_latch & 0xff)) SET_FLAGS(ZF) else CLEAR_FLAGS(ZF);
+        alu_flags(cpu, ALU_OR, *dest, src, cpu->alu_r_latch);
 
         *dest = cpu->alu_r_latch;
     }
@@ -813,9 +271,7 @@ namespace gb {
     void or8(cpu_t* cpu, uint8_t* dest, uint8_t src) {
         cpu->alu_r_latch = (*dest) | src;
 
-        CLEAR_FLAGS(NF | CF | HF);
-
-        if (!(cpu->alu_r_latch & 0xff)) SET_FLAGS(ZF) else CLEAR_FLAGS(ZF);
+        alu_flags(cpu, ALU_OR, *dest, src, cpu->alu_r_latch);
 
         *dest = cpu->alu_r_latch;
     }
@@ -824,285 +280,81 @@ namespace gb {
         cpu->alu_r_latch = *dest;
         cpu->alu_r_latch -= src;
 
-        SET_FLAGS(NF);
-
-        if (  cpu->alu_r_latch > 0xff ) SET_FLAGS(CF) else CLEAR_FLAGS(CF);
-        if (!(cpu->alu_r_latch & 0xff)) SET_FLAGS(ZF) else CLEAR_FLAGS(ZF);
-        //if (((*dest & 0xf) + (src & 0xf)) & 0xf0) SET_FLAGS(HF) else CLEAR_FLAGS(HF);
+        alu_flags(cpu, ALU_SUB, *dest, src, cpu->alu_r_latch);
 
         // *dest = cpu->alu_r_latch & 0xff;
     }
 
-    instruction_state_t add_a_r(cpu_t* cpu) {
-        cpu->y_latch = (cpu->i_latch >> 0) & 0x7;
-
-        add8(cpu, &A, Y, cpu->i_latch & 0x8);
-
-        return IS_LAST_CYCLE;
-    }
-
-    instruction_state_t add_a_n(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            LAST(1, add8(cpu, &A, cpu->l_latch, cpu->i_latch & 0x8));
-
-            INVALID_M;
-        }
-
-        return IS_DONE;    
-    }
-    
-    instruction_state_t add_a_hl(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, HL, &cpu->l_latch, , );
-            LAST(1, add8(cpu, &A, cpu->l_latch, cpu->i_latch & 0x8));
-
-            INVALID_M;
-        }
-
-        return IS_DONE;    
-    }
-
-    instruction_state_t sub_a_r(cpu_t* cpu) {
-        cpu->y_latch = (cpu->i_latch >> 0) & 0x7;
-
-        sub8(cpu, &A, Y, cpu->i_latch & 0x8);
-
-        return IS_LAST_CYCLE;
-    }
-
-    instruction_state_t sub_a_n(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            LAST(1, sub8(cpu, &A, cpu->l_latch, cpu->i_latch & 0x8));
-
-            INVALID_M;
-        }
-
-        return IS_DONE;    
-    }
-    
-    instruction_state_t sub_a_hl(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, HL, &cpu->l_latch, , );
-            LAST(1, sub8(cpu, &A, cpu->l_latch, cpu->i_latch & 0x8));
-
-            INVALID_M;
-        }
-
-        return IS_DONE;    
-    }
-
-    instruction_state_t and_a_r(cpu_t* cpu) {
-        cpu->y_latch = (cpu->i_latch >> 0) & 0x7;
-
-        and8(cpu, &A, Y);
-
-        return IS_LAST_CYCLE;
-    }
-
-    instruction_state_t and_a_n(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            LAST(1, and8(cpu, &A, cpu->l_latch));
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-    
-    instruction_state_t and_a_hl(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, HL, &cpu->l_latch, , );
-            LAST(1, and8(cpu, &A, cpu->l_latch));
-
-            INVALID_M;
-        }
-
-        return IS_DONE;    
-    }
-
-    instruction_state_t xor_a_r(cpu_t* cpu) {
-        cpu->y_latch = (cpu->i_latch >> 0) & 0x7;
-
-        xor8(cpu, &A, Y);
-
-        return IS_LAST_CYCLE;
-    }
-
-    instruction_state_t xor_a_n(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            LAST(1, xor8(cpu, &A, cpu->l_latch));
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-    
-    instruction_state_t xor_a_hl(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, HL, &cpu->l_latch, , );
-            LAST(1, xor8(cpu, &A, cpu->l_latch));
-
-            INVALID_M;
-        }
-
-        return IS_DONE;    
-    }
-
-    instruction_state_t or_a_r(cpu_t* cpu) {
-        cpu->y_latch = (cpu->i_latch >> 0) & 0x7;
-
-        or8(cpu, &A, Y);
-
-        return IS_LAST_CYCLE;
-    }
-
-    instruction_state_t or_a_n(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            LAST(1, or8(cpu, &A, cpu->l_latch));
-
-            INVALID_M;
-        }
-
-        return IS_DONE;
-    }
-    
-    instruction_state_t or_a_hl(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, HL, &cpu->l_latch, , );
-            LAST(1, or8(cpu, &A, cpu->l_latch));
-
-            INVALID_M;
-        }
-
-        return IS_DONE;    
+    // inc r, dec r, and the flags of inc/dec (hl)
+    inline void inc_dec_flags(cpu_t* cpu, uint8_t result) {
+        alu_flags(cpu, ALU_INC, 0, 0, result);
     }
 
-    instruction_state_t cp_a_r(cpu_t* cpu) {
-        cpu->y_latch = (cpu->i_latch >> 0) & 0x7;
-
-        cp8(cpu, &A, Y);
+    // CB rotates and shifts, precomputed for every operand and carry
+    // in: result in the low byte, flags in the high byte
+    constexpr uint16_t cb_rot_compute(uint8_t rot, bool carry, uint8_t v) {
+        uint8_t r = 0;
+        bool c = false;
 
-        return IS_LAST_CYCLE;
-    }
-
-    instruction_state_t cp_a_n(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, cpu->pc++, &cpu->l_latch, , );
-            LAST(1, cp8(cpu, &A, cpu->l_latch));
-
-            INVALID_M;
+        switch (rot) {
+            case CB_RLC: r = (v << 1) | (v >> 7); c = v & 0x80; break;
+            case CB_RRC: r = (v >> 1) | (v << 7); c = v & 0x01; break;
+            case CB_RL: r = (v << 1) | carry; c = v & 0x80; break;
+            case CB_RR: r = (v >> 1) | (carry << 7); c = v & 0x01; break;
+            case CB_SLA: r = v << 1; c = v & 0x80; break;
+            case CB_SRA: r = (v >> 1) | (v & 0x80); c = v & 0x01; break;
+            case CB_SWAP: r = (v << 4) | (v >> 4); break;
+            case CB_SRL: r = v >> 1; c = v & 0x01; break;
         }
 
-        return IS_DONE;
-    }
-    
-    instruction_state_t cp_a_hl(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, HL, &cpu->l_latch, , );
-            LAST(1, cp8(cpu, &A, cpu->l_latch));
-
-            INVALID_M;
-        }
-
-        return IS_DONE;    
-    }
-
-    instruction_state_t inc_r(cpu_t* cpu) {
-        cpu->x_latch = (cpu->i_latch >> 3) & 0x7;
-
-        cpu->r[cpu->x_latch]++;
+        uint8_t f = (r ? 0 : ZF) | (c ? CF : 0);
 
-        CLEAR_FLAGS(NF);
-
-        if (!cpu->r[cpu->x_latch]) SET_FLAGS(ZF) else CLEAR_FLAGS(ZF);
-        if (((cpu->r[cpu->x_latch] & 0xf) + 1) & 0xf0) SET_FLAGS(HF) else CLEAR_FLAGS(HF);
-
-        return IS_LAST_CYCLE;
+        return (f << 8) | r;
     }
 
-    instruction_state_t inc_dhl(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, HL, &cpu->l_latch, , );
-            WRITE(1, HL, ++cpu->l_latch, , );
-            LAST(2,
-                CLEAR_FLAGS(NF);
+    struct cb_rot_table_t {
+        uint16_t e[8][2][256];
+    };
 
-                if (!cpu->r[cpu->x_latch]) SET_FLAGS(ZF) else CLEAR_FLAGS(ZF);
-                if (((cpu->r[cpu->x_latch] & 0xf) + 1) & 0xf0) SET_FLAGS(HF) else CLEAR_FLAGS(HF);
-            );
+    constexpr cb_rot_table_t cb_rot_generate() {
+        cb_rot_table_t t = {};
 
-            INVALID_M;
-        }
+        for (int rot = 0; rot < 8; rot++)
+            for (int carry = 0; carry < 2; carry++)
+                for (int v = 0; v < 256; v++)
+                    t.e[rot][carry][v] = cb_rot_compute(rot, carry, v);
 
-        return IS_DONE;
+        return t;
     }
 
-    instruction_state_t dec_r(cpu_t* cpu) {
-        cpu->x_latch = (cpu->i_latch >> 3) & 0x7;
-
-        cpu->r[cpu->x_latch]--;
+    constexpr cb_rot_table_t cb_rot_table = cb_rot_generate();
 
-        CLEAR_FLAGS(NF);
+    // Everything a CB opcode does once its operand is at hand,
+    // shared by both cores
+    template <uint8_t cb>
+    inline void cb_exec(cpu_t* cpu, uint8_t* v) {
+        constexpr uint8_t x = (cb >> 3) & 0x7;
 
-        if (!cpu->r[cpu->x_latch]) SET_FLAGS(ZF) else CLEAR_FLAGS(ZF);
-        if (((cpu->r[cpu->x_latch] & 0xf) + 1) & 0xf0) SET_FLAGS(HF) else CLEAR_FLAGS(HF);
+        // rot/shift r
+        if constexpr ((cb >> 6) == 0) {
+            bool carry = false;
 
-        return IS_LAST_CYCLE;
-    }
+            if constexpr ((x == CB_RL) || (x == CB_RR))
+                carry = cpu_flags(cpu) & CF;
 
-    instruction_state_t dec_dhl(cpu_t* cpu) {
-        switch (cpu->ex_m_cycle) {
-            READ(0, HL, &cpu->l_latch, , );
-            WRITE(1, HL, --cpu->l_latch, , );
-            LAST(2,
-                CLEAR_FLAGS(NF);
+            uint16_t e = cb_rot_table.e[x][carry][*v];
 
-                if (!cpu->r[cpu->x_latch]) SET_FLAGS(ZF) else CLEAR_FLAGS(ZF);
-                if (((cpu->r[cpu->x_latch] & 0xf) + 1) & 0xf0) SET_FLAGS(HF) else CLEAR_FLAGS(HF);
-            );
+            *v = e & 0xff;
 
-            INVALID_M;
+            alu_flags(cpu, ALU_SET, 0, e >> 8, 0);
         }
 
-        return IS_DONE;
-    }
-
-    instruction_state_t cpl_a(cpu_t* cpu) {
-        A ^= 0xff;
-
-        return IS_LAST_CYCLE;
-    }
-
-    instruction_state_t scf(cpu_t* cpu) {
-        SET_FLAGS(CF);
+        // bit b, r: same flags as and
+        if constexpr ((cb >> 6) == 1) alu_flags(cpu, ALU_AND, *v, 1 << x, *v & (1 << x));
 
-        return IS_LAST_CYCLE;
-    }
-    
-    instruction_state_t ccf(cpu_t* cpu) {
-        CLEAR_FLAGS(CF);
-
-        return IS_LAST_CYCLE;
-    }
-
-    instruction_state_t cb(cpu_t* cpu) {
-        _log(debug, "CB prefix unimplemented!", cpu->i_latch);
-
-        cpu->pc++;
-
-        return IS_LAST_CYCLE;
-    }
-
-    instruction_state_t unk(cpu_t* cpu) {
-        _log(debug, "Unimplemented instruction %02x!", cpu->i_latch);
-
-        return IS_LAST_CYCLE;
+        // res b, r / set b, r
+        if constexpr ((cb >> 6) == 2) *v &= ~(1 << x);
+        if constexpr ((cb >> 6) == 3) *v |= (1 << x);
     }
 }
 
@@ -1122,13 +374,7 @@ namespace gb {
 #undef HL
 #undef NN
 
-#undef READ
-#undef WRITE
-#undef IDLE
-
 #undef ZF
 #undef NF
 #undef HF
 #undef CF
-
-#undef INVALID_M
\ No newline at end of file
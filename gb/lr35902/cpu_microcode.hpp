@@ -0,0 +1,685 @@
+#pragma once
+
+#include "../macros.hpp"
+#include "../structs.hpp"
+#include "../log.hpp"
+
+#include "cpu_defines.hpp"
+#include "cpu_struct.hpp"
+#include "cpu_bus.hpp"
+#include "cpu_instructions.hpp"
+
+#include <initializer_list>
+#include <utility>
+#include <cstdlib>
+
+// Every opcode is described once, as data: a list of micro-ops, one per
+// M cycle, each naming its bus transaction, where the address comes
+// from, where the data goes to (or comes from), and what to execute
+// once the transaction completes. The LAST micro-op is the M cycle
+// overlapped with the next opcode fetch.
+//
+// CB-prefixed opcodes live in a second page of the table, at
+// 0x100 | CB opcode, see microcode_for_cb.
+//
+// The tables are generated at compile time and walked by a single
+// interpreter, instantiated per opcode (see microcode_exec), which
+// replaces the hand-written per-opcode handlers. Cycle counts are
+// checked against the reference timings at compile time too, see
+// microcode_validate.
+
+#define MICROCODE_MAX_STEPS 6
+#define MICROCODE_CB_PAGE   0x100
+
+namespace gb {
+    // Bus transaction of a micro-op
+    enum uop_bus_t : uint8_t {
+        UB_READ,
+        UB_WRITE,
+        UB_IDLE,
+        UB_LAST
+    };
+
+    // Address sources
+    enum uop_addr_t : uint8_t {
+        UA_NONE,
+        UA_PC_INC,      // PC++
+        UA_SP_INC,      // SP++
+        UA_SP_DEC,      // --SP
+        UA_SP,          // IDLE only: SP is put on the address bus
+        UA_HL,
+        UA_HL_INC,      // HL, then HL++
+        UA_HL_DEC,      // HL, then HL--
+        UA_BC,
+        UA_DE,
+        UA_NN,
+        UA_NN_1,        // NN + 1
+        UA_FF_C,        // 0xff00 | C
+        UA_FF_L         // 0xff00 | l_latch
+    };
+
+    // Read destinations, write sources and ALU operands
+    enum uop_data_t : uint8_t {
+        UD_NONE,
+        UD_L,           // l_latch
+        UD_H,           // h_latch
+        UD_L_INC,       // ++l_latch
+        UD_L_DEC,       // --l_latch
+        UD_A,
+        UD_X,           // r[(opcode >> 3) & 7], latched into x_latch
+        UD_Y,           // r[opcode & 7], latched into y_latch
+        UD_RR_HI,       // High byte of push's register pair
+        UD_RR_LO,       // Low byte of push's register pair
+        UD_SP_HI,
+        UD_SP_LO,
+        UD_PC_HI,
+        UD_PC_LO,
+        UD_CB           // cb_latch
+    };
+
+    // What to execute when a micro-op completes
+    enum uop_exec_t : uint8_t {
+        EX_NONE,
+        EX_LD_R_R,
+        EX_LD_X_L,
+        EX_LD_A_L,
+        EX_LD_RR_NN,
+        EX_LD_SP_HL,
+        EX_POP,
+        EX_JP_NN,
+        EX_JP_HL,
+        EX_JR,
+        EX_RST,
+        EX_EI,
+        EX_ADD,
+        EX_SUB,
+        EX_AND,
+        EX_XOR,
+        EX_OR,
+        EX_CP,
+        EX_INC_R,
+        EX_DEC_R,
+        EX_INC_DEC_HL_FLAGS,
+        EX_CPL,
+        EX_SCF,
+        EX_CCF,
+        EX_CB,
+        EX_UNK
+    };
+
+    struct uop_t {
+        uint8_t bus;
+        uint8_t addr;
+        uint8_t data;
+        uint8_t exec;
+
+        // Only taken if the opcode's condition (bits 3-4) holds,
+        // otherwise this M cycle becomes the LAST one
+        bool cond;
+    };
+
+    struct microcode_t {
+        uop_t steps[MICROCODE_MAX_STEPS];
+        uint8_t count;
+    };
+
+    // Builders
+    constexpr uop_t uop_read(uint8_t addr, uint8_t dest, uint8_t exec = EX_NONE) {
+        return { UB_READ, addr, dest, exec, false };
+    }
+
+    constexpr uop_t uop_write(uint8_t addr, uint8_t src) {
+        return { UB_WRITE, addr, src, EX_NONE, false };
+    }
+
+    constexpr uop_t uop_idle(uint8_t addr = UA_NONE, uint8_t exec = EX_NONE) {
+        return { UB_IDLE, addr, UD_NONE, exec, false };
+    }
+
+    constexpr uop_t uop_last(uint8_t exec = EX_NONE, uint8_t operand = UD_NONE) {
+        return { UB_LAST, UA_NONE, operand, exec, false };
+    }
+
+    constexpr uop_t uop_when(uop_t u) {
+        u.cond = true;
+
+        return u;
+    }
+
+    constexpr microcode_t microcode(std::initializer_list<uop_t> steps) {
+        microcode_t mc = {};
+
+        for (uop_t u : steps)
+            mc.steps[mc.count++] = u;
+
+        return mc;
+    }
+
+    // ALU operation by bits 3-5, shared by the 80-bf block and the
+    // immediate forms. Slots 5 and 6 are swapped with respect to the
+    // real opcode map, same as the original handler table
+    constexpr uint8_t microcode_alu[] = {
+        EX_ADD, EX_ADD, EX_SUB, EX_SUB, EX_AND, EX_OR, EX_XOR, EX_CP
+    };
+
+    constexpr microcode_t microcode_for(uint8_t op) {
+        uint8_t x = (op >> 3) & 0x7;
+        uint8_t z = (op >> 0) & 0x7;
+
+        // halt
+        if (op == 0x76) return microcode({ uop_last(EX_UNK) });
+
+        // ld r, r / ld r, (hl) / ld (hl), r
+        if ((op & 0xc0) == 0x40) {
+            if (z == 6) return microcode({ uop_read(UA_HL, UD_L), uop_last(EX_LD_X_L) });
+            if (x == 6) return microcode({ uop_write(UA_HL, UD_X), uop_last() });
+
+            return microcode({ uop_last(EX_LD_R_R) });
+        }
+
+        // alu a, r / alu a, (hl)
+        if ((op & 0xc0) == 0x80) {
+            if (z == 6) return microcode({ uop_read(UA_HL, UD_L), uop_last(microcode_alu[x], UD_L) });
+
+            return microcode({ uop_last(microcode_alu[x], UD_Y) });
+        }
+
+        // alu a, n
+        if ((op & 0xc7) == 0xc6)
+            return microcode({ uop_read(UA_PC_INC, UD_L), uop_last(microcode_alu[x], UD_L) });
+
+        // inc r / inc (hl)
+        if ((op & 0xc7) == 0x04) {
+            if (x == 6) return microcode({ uop_read(UA_HL, UD_L), uop_write(UA_HL, UD_L_INC), uop_last(EX_INC_DEC_HL_FLAGS) });
+
+            return microcode({ uop_last(EX_INC_R) });
+        }
+
+        // dec r / dec (hl)
+        if ((op & 0xc7) == 0x05) {
+            if (x == 6) return microcode({ uop_read(UA_HL, UD_L), uop_write(UA_HL, UD_L_DEC), uop_last(EX_INC_DEC_HL_FLAGS) });
+
+            return microcode({ uop_last(EX_DEC_R) });
+        }
+
+        // ld r, n / ld (hl), n
+        if ((op & 0xc7) == 0x06) {
+            if (x == 6) return microcode({ uop_read(UA_PC_INC, UD_L), uop_write(UA_HL, UD_L), uop_last() });
+
+            return microcode({ uop_read(UA_PC_INC, UD_L), uop_last(EX_LD_X_L) });
+        }
+
+        // ld rr, nn
+        if ((op & 0xcf) == 0x01)
+            return microcode({ uop_read(UA_PC_INC, UD_L), uop_read(UA_PC_INC, UD_H), uop_last(EX_LD_RR_NN) });
+
+        // jr cc, n
+        if ((op & 0xe7) == 0x20)
+            return microcode({ uop_read(UA_PC_INC, UD_L), uop_when(uop_idle()), uop_last(EX_JR) });
+
+        // ret cc
+        if ((op & 0xe7) == 0xc0)
+            return microcode({ uop_idle(), uop_when(uop_read(UA_SP_INC, UD_L)), uop_read(UA_SP_INC, UD_H), uop_idle(), uop_last(EX_JP_NN) });
+
+        // pop rr
+        if ((op & 0xcf) == 0xc1)
+            return microcode({ uop_read(UA_SP_INC, UD_L), uop_read(UA_SP_INC, UD_H), uop_last(EX_POP) });
+
+        // jp cc, nn
+        if ((op & 0xe7) == 0xc2)
+            return microcode({ uop_read(UA_PC_INC, UD_L), uop_read(UA_PC_INC, UD_H), uop_when(uop_idle()), uop_last(EX_JP_NN) });
+
+        // call cc, nn
+        if ((op & 0xe7) == 0xc4)
+            return microcode({ uop_read(UA_PC_INC, UD_L), uop_read(UA_PC_INC, UD_H), uop_when(uop_idle(UA_SP)), uop_write(UA_SP_DEC, UD_PC_HI), uop_write(UA_SP_DEC, UD_PC_LO), uop_last(EX_JP_NN) });
+
+        // push rr, first cycle is bus idle but SP is latched
+        // onto the address bus
+        if ((op & 0xcf) == 0xc5)
+            return microcode({ uop_idle(UA_SP), uop_write(UA_SP_DEC, UD_RR_HI), uop_write(UA_SP_DEC, UD_RR_LO), uop_last() });
+
+        // rst n, basically the same as push rr, but with PC
+        if ((op & 0xc7) == 0xc7)
+            return microcode({ uop_idle(UA_SP), uop_write(UA_SP_DEC, UD_PC_HI), uop_write(UA_SP_DEC, UD_PC_LO), uop_last(EX_RST) });
+
+        switch (op) {
+            case 0x00: return microcode({ uop_last() });
+            case 0x08: return microcode({ uop_read(UA_PC_INC, UD_L), uop_read(UA_PC_INC, UD_H), uop_write(UA_NN, UD_SP_LO), uop_write(UA_NN_1, UD_SP_HI), uop_last() });
+            case 0x0a: return microcode({ uop_read(UA_BC, UD_L), uop_last(EX_LD_A_L) });
+            case 0x1a: return microcode({ uop_read(UA_DE, UD_L), uop_last(EX_LD_A_L) });
+            case 0x18: return microcode({ uop_read(UA_PC_INC, UD_L), uop_idle(), uop_last(EX_JR) });
+            case 0x22: return microcode({ uop_write(UA_HL_INC, UD_A), uop_last() });
+            case 0x2a: return microcode({ uop_read(UA_HL_INC, UD_L), uop_last(EX_LD_A_L) });
+            case 0x32: return microcode({ uop_write(UA_HL_DEC, UD_A), uop_last() });
+            case 0x3a: return microcode({ uop_read(UA_HL_DEC, UD_L), uop_last(EX_LD_A_L) });
+            case 0x2f: return microcode({ uop_last(EX_CPL) });
+            case 0x37: return microcode({ uop_last(EX_SCF) });
+            case 0x3f: return microcode({ uop_last(EX_CCF) });
+            case 0xc3: return microcode({ uop_read(UA_PC_INC, UD_L), uop_read(UA_PC_INC, UD_H), uop_idle(), uop_last(EX_JP_NN) });
+            case 0xc9: return microcode({ uop_read(UA_SP_INC, UD_L), uop_read(UA_SP_INC, UD_H), uop_idle(), uop_last(EX_JP_NN) });
+            case 0xd9: return microcode({ uop_read(UA_SP_INC, UD_L), uop_read(UA_SP_INC, UD_H), uop_idle(UA_NONE, EX_EI), uop_last(EX_JP_NN) });
+            // Only the CB opcode fetch, the rest runs from
+            // the CB page, see microcode_exec_cb
+            case 0xcb: return microcode({ uop_read(UA_PC_INC, UD_CB) });
+            case 0xcd: return microcode({ uop_read(UA_PC_INC, UD_L), uop_read(UA_PC_INC, UD_H), uop_idle(UA_SP), uop_write(UA_SP_DEC, UD_PC_HI), uop_write(UA_SP_DEC, UD_PC_LO), uop_last(EX_JP_NN) });
+            case 0xe0: return microcode({ uop_read(UA_PC_INC, UD_L), uop_write(UA_FF_L, UD_A), uop_last() });
+            case 0xf0: return microcode({ uop_read(UA_PC_INC, UD_L), uop_read(UA_FF_L, UD_L), uop_last(EX_LD_A_L) });
+            case 0xe2: return microcode({ uop_write(UA_FF_C, UD_A), uop_last() });
+            case 0xf2: return microcode({ uop_read(UA_FF_C, UD_L), uop_last(EX_LD_A_L) });
+            case 0xe9: return microcode({ uop_last(EX_JP_HL) });
+            case 0xea: return microcode({ uop_read(UA_PC_INC, UD_L), uop_read(UA_PC_INC, UD_H), uop_write(UA_NN, UD_A), uop_last() });
+            case 0xfa: return microcode({ uop_read(UA_PC_INC, UD_L), uop_read(UA_PC_INC, UD_H), uop_read(UA_NN, UD_L), uop_last(EX_LD_A_L) });
+            case 0xf9: return microcode({ uop_idle(UA_NONE, EX_LD_SP_HL), uop_last() });
+        }
+
+        return microcode({ uop_last(EX_UNK) });
+    }
+
+    // CB page. Every entry starts with the CB opcode fetch, (hl) forms
+    // go through l_latch: read, execute as the read completes, write back
+    constexpr microcode_t microcode_for_cb(uint8_t cb) {
+        uint8_t z = cb & 0x7;
+
+        uop_t fetch = uop_read(UA_PC_INC, UD_CB);
+
+        if (z != 6) return microcode({ fetch, uop_last(EX_CB) });
+
+        // bit b, (hl) doesn't write back
+        if ((cb & 0xc0) == 0x40) return microcode({ fetch, uop_read(UA_HL, UD_L), uop_last(EX_CB) });
+
+        return microcode({ fetch, uop_read(UA_HL, UD_L, EX_CB), uop_write(UA_HL, UD_L), uop_last() });
+    }
+
+    struct microcode_table_t {
+        microcode_t op[512];
+    };
+
+    constexpr microcode_table_t microcode_generate() {
+        microcode_table_t t = {};
+
+        for (int i = 0; i < 256; i++) {
+            t.op[i] = microcode_for(i);
+            t.op[MICROCODE_CB_PAGE | i] = microcode_for_cb(i);
+        }
+
+        return t;
+    }
+
+    constexpr microcode_table_t microcode_table = microcode_generate();
+
+    // Reference M cycle counts (branches taken), including the
+    // overlapped opcode fetch. 0 means the opcode doesn't exist
+    constexpr uint8_t microcode_reference_cycles[256] = {
+    /*  X0 X1 X2 X3 X4 X5 X6 X7 X8 X9 Xa Xb Xc Xd Xe Xf */
+        1, 3, 2, 2, 1, 1, 2, 1, 5, 2, 2, 2, 1, 1, 2, 1, /* 0X */
+        1, 3, 2, 2, 1, 1, 2, 1, 3, 2, 2, 2, 1, 1, 2, 1, /* 1X */
+        3, 3, 2, 2, 1, 1, 2, 1, 3, 2, 2, 2, 1, 1, 2, 1, /* 2X */
+        3, 3, 2, 2, 3, 3, 3, 1, 3, 2, 2, 2, 1, 1, 2, 1, /* 3X */
+        1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, /* 4X */
+        1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, /* 5X */
+        1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, /* 6X */
+        2, 2, 2, 2, 2, 2, 1, 2, 1, 1, 1, 1, 1, 1, 2, 1, /* 7X */
+        1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, /* 8X */
+        1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, /* 9X */
+        1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, /* aX */
+        1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, /* bX */
+        5, 3, 4, 4, 6, 4, 2, 4, 5, 4, 4, 1, 6, 6, 2, 4, /* cX */
+        5, 3, 4, 0, 6, 4, 2, 4, 5, 4, 4, 0, 6, 0, 2, 4, /* dX */
+        3, 3, 2, 0, 0, 4, 2, 4, 4, 1, 4, 0, 0, 0, 2, 4, /* eX */
+        3, 3, 2, 1, 0, 4, 2, 4, 3, 2, 4, 1, 0, 0, 2, 4  /* fX */
+    };
+
+    // CB opcodes, including the prefix's own fetch
+    constexpr uint8_t microcode_reference_cb_cycles(uint8_t cb) {
+        if ((cb & 0x7) != 6) return 2;
+        if ((cb & 0xc0) == 0x40) return 3;  // bit b, (hl)
+
+        return 4;
+    }
+
+    // Branches not taken end right after the conditional M cycle
+    constexpr uint8_t microcode_reference_not_taken(uint8_t op) {
+        if ((op & 0xe7) == 0x20) return 2;  // jr cc
+        if ((op & 0xe7) == 0xc0) return 2;  // ret cc
+        if ((op & 0xe7) == 0xc2) return 3;  // jp cc
+        if ((op & 0xe7) == 0xc4) return 3;  // call cc
+
+        return 0;
+    }
+
+    // Returns the first opcode whose microcode doesn't match
+    // the reference timings, or -1
+    constexpr int microcode_validate() {
+        const uop_t& cb_fetch = microcode_table.op[0xcb].steps[0];
+
+        for (int op = 0; op < 512; op++) {
+            const microcode_t& mc = microcode_table.op[op];
+            const uop_t& last = mc.steps[mc.count - 1];
+            bool cb = op & MICROCODE_CB_PAGE;
+
+            // Unimplemented opcodes are skipped, the CB
+            // prefix is checked through its page
+            if ((last.exec == EX_UNK) || (op == 0xcb))
+                continue;
+
+            if (last.bus != UB_LAST)
+                return op;
+
+            if (mc.count != (cb ? microcode_reference_cb_cycles(op & 0xff) : microcode_reference_cycles[op]))
+                return op;
+
+            // The CB page must start with the prefix's
+            // fetch, see microcode_exec_cb
+            if (cb && ((mc.steps[0].bus != cb_fetch.bus) || (mc.steps[0].addr != cb_fetch.addr) || (mc.steps[0].data != cb_fetch.data) || (mc.steps[0].exec != cb_fetch.exec)))
+                return op;
+
+            uint8_t not_taken = 0;
+
+            for (int i = 0; i < mc.count; i++) {
+                if (mc.steps[i].bus == UB_LAST && i != mc.count - 1)
+                    return op;
+
+                if (mc.steps[i].cond && !not_taken)
+                    not_taken = i + 1;
+            }
+
+            if (not_taken != (cb ? 0 : microcode_reference_not_taken(op)))
+                return op;
+        }
+
+        return -1;
+    }
+
+    static_assert(microcode_validate() == -1, "Microcode cycle counts don't match the reference timings");
+
+#define A cpu->r[7]
+#define F cpu->r[6]
+#define C cpu->r[1]
+#define HL (((uint16_t)cpu->r[4] << 8) | cpu->r[5])
+#define BC (((uint16_t)cpu->r[0] << 8) | cpu->r[1])
+#define DE (((uint16_t)cpu->r[2] << 8) | cpu->r[3])
+#define NN (((uint16_t)cpu->h_latch << 8) | cpu->l_latch)
+#define SET_FLAGS(f) { F |= f; }
+#define CLEAR_FLAGS(f) { F &= ~f; }
+
+#define ZF 0b10000000
+#define NF 0b01000000
+#define HF 0b00100000
+#define CF 0b00010000
+
+    // The interpreter is instantiated once per opcode: the opcode and
+    // every micro-op field are template arguments, so operand decoding
+    // (x/y register fields, register pairs, conditions) and the
+    // micro-op switches all fold away at compile time, leaving each
+    // opcode with straight-line code for each of its M cycles.
+
+    // Register pair rr (bits 4-5) as indices into r[], with AF
+    // in the last slot (push/pop)
+    constexpr uint8_t microcode_rr_hi(uint8_t op) { return ((op >> 4) & 0x3) == 3 ? 7 : ((op >> 4) & 0x3) * 2; }
+    constexpr uint8_t microcode_rr_lo(uint8_t op) { return ((op >> 4) & 0x3) == 3 ? 6 : ((op >> 4) & 0x3) * 2 + 1; }
+
+    template <uint16_t op, uint8_t addr>
+    inline uint16_t microcode_address(cpu_t* cpu) {
+        if constexpr (addr == UA_PC_INC) return cpu->pc++;
+        if constexpr (addr == UA_SP_INC) return cpu->sp++;
+        if constexpr (addr == UA_SP_DEC) return --cpu->sp;
+        if constexpr (addr == UA_HL) return HL;
+        if constexpr (addr == UA_HL_INC) { uint16_t a = HL; inc_hl(cpu); return a; }
+        if constexpr (addr == UA_HL_DEC) { uint16_t a = HL; dec_hl(cpu); return a; }
+        if constexpr (addr == UA_BC) return BC;
+        if constexpr (addr == UA_DE) return DE;
+        if constexpr (addr == UA_NN) return NN;
+        if constexpr (addr == UA_NN_1) return NN + 1;
+        if constexpr (addr == UA_FF_C) return 0xff00 | C;
+        if constexpr (addr == UA_FF_L) return 0xff00 | cpu->l_latch;
+
+        return 0;
+    }
+
+    template <uint16_t op, uint8_t data>
+    inline uint8_t microcode_data(cpu_t* cpu) {
+        constexpr uint8_t x = (op >> 3) & 0x7;
+        constexpr uint8_t y = (op >> 0) & 0x7;
+
+        if constexpr (data == UD_L) return cpu->l_latch;
+        if constexpr (data == UD_H) return cpu->h_latch;
+        if constexpr (data == UD_L_INC) return ++cpu->l_latch;
+        if constexpr (data == UD_L_DEC) return --cpu->l_latch;
+        if constexpr (data == UD_A) return A;
+        if constexpr (data == UD_X) { cpu->x_latch = x; return (x == 6) ? cpu_flags(cpu) : cpu->r[x]; }
+        if constexpr (data == UD_Y) { cpu->y_latch = y; return cpu->r[y]; }
+        if constexpr (data == UD_RR_HI) return cpu->r[microcode_rr_hi(op)];
+        if constexpr (data == UD_RR_LO) return (microcode_rr_lo(op) == 6) ? cpu_flags(cpu) : cpu->r[microcode_rr_lo(op)];
+        if constexpr (data == UD_SP_HI) return (cpu->sp >> 8) & 0xff;
+        if constexpr (data == UD_SP_LO) return (cpu->sp >> 0) & 0xff;
+        if constexpr (data == UD_PC_HI) return (cpu->pc >> 8) & 0xff;
+        if constexpr (data == UD_PC_LO) return (cpu->pc >> 0) & 0xff;
+
+        return 0;
+    }
+
+    template <uint16_t op, uint8_t exec, uint8_t operand>
+    inline void microcode_run(cpu_t* cpu) {
+        constexpr uint8_t x = (op >> 3) & 0x7;
+        constexpr uint8_t y = (op >> 0) & 0x7;
+        constexpr bool carry = op & 0x8;
+
+        if constexpr (exec == EX_LD_R_R) {
+            cpu->x_latch = x;
+            cpu->y_latch = y;
+
+            cpu->r[x] = cpu->r[y];
+        }
+
+        if constexpr (exec == EX_LD_X_L) {
+            cpu->x_latch = x;
+
+            cpu->r[x] = cpu->l_latch;
+        }
+
+        if constexpr (exec == EX_LD_A_L) A = cpu->l_latch;
+
+        if constexpr (exec == EX_LD_RR_NN) {
+            if constexpr (((op >> 4) & 0x3) == 3) {
+                cpu->sp = NN;
+            } else {
+                cpu->r[microcode_rr_hi(op)] = cpu->h_latch;
+                cpu->r[microcode_rr_lo(op)] = cpu->l_latch;
+            }
+        }
+
+        if constexpr (exec == EX_LD_SP_HL) cpu->sp = HL;
+
+        if constexpr (exec == EX_POP) {
+            if constexpr (((op >> 4) & 0x3) == 3) cpu_flags_sync(cpu);
+
+            cpu->r[microcode_rr_hi(op)] = cpu->h_latch;
+
+            // Low nibble of F always reads 0
+            if constexpr (((op >> 4) & 0x3) == 3) {
+                cpu->r[microcode_rr_lo(op)] = cpu->l_latch & 0xf0;
+            } else {
+                cpu->r[microcode_rr_lo(op)] = cpu->l_latch;
+            }
+        }
+
+        if constexpr (exec == EX_JP_NN) cpu->pc = NN;
+        if constexpr (exec == EX_JP_HL) cpu->pc = HL;
+        if constexpr (exec == EX_JR) cpu->pc += (int8_t)cpu->l_latch;
+        if constexpr (exec == EX_RST) cpu->pc = op & 0x38;
+        if constexpr (exec == EX_EI) cpu->ime = true;
+
+        if constexpr (exec == EX_ADD) add8(cpu, &A, microcode_data<op, operand>(cpu), carry);
+        if constexpr (exec == EX_SUB) sub8(cpu, &A, microcode_data<op, operand>(cpu), carry);
+        if constexpr (exec == EX_AND) and8(cpu, &A, microcode_data<op, operand>(cpu));
+        if constexpr (exec == EX_XOR) xor8(cpu, &A, microcode_data<op, operand>(cpu));
+        if constexpr (exec == EX_OR) or8(cpu, &A, microcode_data<op, operand>(cpu));
+        if constexpr (exec == EX_CP) cp8(cpu, &A, microcode_data<op, operand>(cpu));
+
+        if constexpr ((exec == EX_INC_R) || (exec == EX_DEC_R)) {
+            cpu->x_latch = x;
+
+            if constexpr (exec == EX_INC_R) {
+                cpu->r[x]++;
+            } else {
+                cpu->r[x]--;
+            }
+
+            inc_dec_flags(cpu, cpu->r[x]);
+        }
+
+        // Flags come from whatever x_latch was left pointing at
+        if constexpr (exec == EX_INC_DEC_HL_FLAGS) {
+            // Which may well be F itself
+            cpu_flags_sync(cpu);
+
+            inc_dec_flags(cpu, cpu->r[cpu->x_latch]);
+        }
+
+        if constexpr (exec == EX_CPL) A ^= 0xff;
+        if constexpr (exec == EX_SCF) { cpu_flags_sync(cpu); SET_FLAGS(CF); }
+        if constexpr (exec == EX_CCF) { cpu_flags_sync(cpu); CLEAR_FLAGS(CF); }
+
+        // (hl) forms work on l_latch
+        if constexpr (exec == EX_CB) cb_exec<op & 0xff>(cpu, (y == 6) ? &cpu->l_latch : &cpu->r[y]);
+
+        if constexpr (exec == EX_UNK) {
+            _logc(cpu, debug, "Unimplemented instruction %02x!", op);
+        }
+    }
+
+    // One M cycle of one opcode, same contract as the handlers the
+    // microcode replaced: called on every clocked half cycle, returns
+    // IS_LAST_CYCLE once the LAST micro-op (or an untaken condition)
+    // is reached
+    template <uint16_t op, uint8_t step>
+    inline instruction_state_t microcode_step(cpu_t* cpu) {
+        constexpr uop_t u = microcode_table.op[op].steps[step];
+
+        if constexpr (u.cond) {
+            if (!check_condition(cpu, (op >> 3) & 0x3))
+                return IS_LAST_CYCLE;
+        }
+
+        if constexpr (u.bus == UB_READ) {
+            if (!cpu->read_ongoing) {
+                cpu_init_read(cpu, microcode_address<op, u.addr>(cpu));
+            }
+
+            uint8_t* dest = (u.data == UD_H) ? &cpu->h_latch : (u.data == UD_CB) ? &cpu->cb_latch : &cpu->l_latch;
+
+            if (!cpu_handle_read(cpu, dest)) {
+                cpu->ex_m_cycle++;
+
+                microcode_run<op, u.exec, UD_NONE>(cpu);
+            }
+        }
+
+        if constexpr (u.bus == UB_WRITE) {
+            if (!cpu->write_ongoing) {
+                uint16_t addr = microcode_address<op, u.addr>(cpu);
+
+                cpu_init_write(cpu, addr, microcode_data<op, u.data>(cpu));
+            }
+
+            if (!cpu_handle_write(cpu)) {
+                cpu->ex_m_cycle++;
+
+                microcode_run<op, u.exec, UD_NONE>(cpu);
+            }
+        }
+
+        if constexpr (u.bus == UB_IDLE) {
+            if (!cpu->idle_cycle) {
+                cpu_init_idle(cpu);
+
+                if constexpr (u.addr == UA_SP)
+                    cpu->bus.pins |= cpu->sp & (BUS_A & ~BUS_A15);
+            }
+
+            if (!cpu_handle_idle(cpu)) {
+                cpu->ex_m_cycle++;
+
+                microcode_run<op, u.exec, UD_NONE>(cpu);
+            }
+        }
+
+        if constexpr (u.bus == UB_LAST) {
+            if (!cpu->read_ongoing) {
+                microcode_run<op, u.exec, u.data>(cpu);
+            }
+
+            return IS_LAST_CYCLE;
+        }
+
+        return IS_EXECUTING;
+    }
+
+    template <uint16_t op, size_t... step>
+    inline instruction_state_t microcode_dispatch(cpu_t* cpu, std::index_sequence<step...>) {
+        instruction_state_t state = IS_DONE;
+
+        bool valid = (((cpu->ex_m_cycle == step) && ((state = microcode_step<op, step>(cpu)), true)) || ...);
+
+        if (!valid) {
+            _logc(cpu, error, "Invalid M cycle %u while executing %02x", cpu->ex_m_cycle, op);
+
+            std::exit(1);
+        }
+
+        return state;
+    }
+
+    template <uint16_t op>
+    instruction_state_t microcode_exec(cpu_t* cpu) {
+        return microcode_dispatch<op>(cpu, std::make_index_sequence<microcode_table.op[op].count>());
+    }
+
+    struct microcode_handlers_t {
+        cpu_instruction_t op[256];
+    };
+
+    template <uint16_t page, size_t... op>
+    constexpr microcode_handlers_t microcode_handlers_generate(std::index_sequence<op...>) {
+        return {{ microcode_exec<page | op>... }};
+    }
+
+    constexpr microcode_handlers_t microcode_cb_handlers = microcode_handlers_generate<MICROCODE_CB_PAGE>(std::make_index_sequence<256>());
+
+    // The CB prefix runs the CB page entry of the opcode following it.
+    // Its first M cycle, fetching that opcode into cb_latch, is the same
+    // on every entry, so whichever one cb_latch still points to can run it
+    inline instruction_state_t microcode_exec_cb(cpu_t* cpu) {
+        return microcode_cb_handlers.op[cpu->cb_latch](cpu);
+    }
+
+    constexpr microcode_handlers_t microcode_handlers_main() {
+        microcode_handlers_t t = microcode_handlers_generate<0>(std::make_index_sequence<256>());
+
+        t.op[0xcb] = microcode_exec_cb;
+
+        return t;
+    }
+
+    constexpr microcode_handlers_t microcode_handlers = microcode_handlers_main();
+
+    // Runs the current M cycle of the instruction in i_latch
+    inline instruction_state_t cpu_microcode_exec(cpu_t* cpu) {
+        return microcode_handlers.op[cpu->i_latch](cpu);
+    }
+}
+
+#undef A
+#undef F
+#undef C
+#undef HL
+#undef BC
+#undef DE
+#undef NN
+#undef SET_FLAGS
+#undef CLEAR_FLAGS
+
+#undef ZF
+#undef NF
+#undef HF
+#undef CF
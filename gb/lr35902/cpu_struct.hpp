@@ -17,6 +17,9 @@ namespace gb {
         bool* main_bus_set;
         bool* vram_bus_set;
 
+        // The SoC's boot ROM, may be set after init
+        bootrom_t** boot;
+
         bool read_ongoing;
         bool write_ongoing;
         bool idle_cycle;
@@ -28,12 +31,25 @@ namespace gb {
         uint16_t a_latch;
         uint8_t d_latch;
 
+        // Region of the latched address (bus_region_t)
+        uint8_t region;
+
+        // Pin waveform variant (bus_waveform_id_t)
+        uint8_t waveform;
+
         // Main registers
         uint8_t r[8];
         uint16_t pc;
         uint16_t sp;
         int32_t alu_r_latch; 
 
+        // Last flag-setting ALU op, its operands and result. With
+        // GB_LAZY_FLAGS, F (r[6]) is only worked out from these when
+        // something reads it, see cpu_flags
+        uint8_t alu_op;
+        uint8_t alu_a, alu_b;
+        int16_t alu_r;
+
         // Latches for encoded operands
         uint8_t x_latch, y_latch;
 
@@ -50,11 +66,17 @@ namespace gb {
         uint8_t temp_i_latch;
         uint8_t i_latch;
 
+        // Opcode following a CB prefix
+        uint8_t cb_latch;
+
         // Data fetch latches
         uint8_t l_latch, h_latch;
 
         uint8_t state = ST_FETCH;
 
+        // Threaded dispatch resume point (cpu_resume_t)
+        uint8_t resume;
+
         uint64_t total_t_cycles;
     };
 }
\ No newline at end of file
@@ -7,12 +7,12 @@
 #include "../macros.hpp"
 
 #include "lr35902_struct.hpp"
+#include "bus_funcs.hpp"
 
 #include "cpu_struct.hpp"
 #include "cpu_funcs.hpp"
 #include "bootrom_struct.hpp"
-
-#define RANGE(v, l, h) ((v >= l) && (v <= h))
+#include "bootrom_funcs.hpp"
 
 namespace gb {
     void lr35902_init(lr35902_t* lr35902) {
@@ -20,51 +20,62 @@ namespace gb {
 
         lr35902->pins.ck[0] = true;
         lr35902->pins.phi = true;
-        lr35902->ext_bus = &lr35902_idle_ext_bus;
-    }
+        lr35902->idle_bus.pins = bus_pins(
+            /* a  */ 0x8000,
+            /* d  */ 0xff,
+            /* wr */ true,
+            /* rd */ true,
+            /* cs */ true
+        );
 
-    inline bool lr35902_is_internal_cycle(lr35902_t* lr35902) {
-        // If BootROM is mapped
-        if (!lr35902->boot->boot_off) {
+        lr35902->ext_bus = lr35902->idle_bus;
 
-            // If A0-A15 is within bootROM then internal cycle
-            return RANGE(lr35902->cpu->bus.a, 0x0000, 0x00ff);
-        }
+        bus_publisher_init(&lr35902->ext_pub, &lr35902->ext_bus);
+    }
 
-        return (lr35902->cpu->bus.a & 0x8000) &&   // A15 is high
-               (lr35902->cpu->bus.cs);             // CS is high
+    // Pins the SoC routes out on the half cycle at `now`, all
+    // ones if the CPU's bus is external, zero if it's internal.
+    // Comes from the region latched with the current access
+    inline uint32_t lr35902_drive_mask(lr35902_t* lr35902, uint64_t now) {
+        cpu_t* cpu = lr35902->cpu;
+
+        return 0u - ((bus_waveforms[cpu->waveform].external[cpu->region] >> (now & (M - 1))) & 1);
     }
 
-    void lr35902_clock(lr35902_t* lr35902) {
-        // Copy D0-D7 between external and CPU
-        // depending on whether the CPU is reading
-        // or writing. (Only on external cycles)
-
-        // if (!lr35902_is_internal_cycle(lr35902)) {
-        //     if (cpu_bus_is_read(lr35902->cpu)) {
-        //         lr35902->cpu->bus.d = lr35902->ext_bus->d;
-        //     } else if (cpu_bus_is_write(lr35902->cpu)) {
-        //         lr35902->ext_bus->d = lr35902->cpu->bus.d;
-        //     }
-        // }
-
-        // This might work before and after??
-        // Set external bus depending on whether the last
-        // CPU cycle was an internal or external cycle
-        if (lr35902_is_internal_cycle(lr35902)) {
-            lr35902->ext_bus = &lr35902_idle_ext_bus;
-        } else {
-            lr35902->ext_bus = &lr35902->cpu->bus;
+    // Accesses that never leave the SoC are served on the select
+    // half cycle straight off the CPU's latches, D0-D7 then hold
+    // until the CPU latches them on ck=6
+    inline void lr35902_internal_access(lr35902_t* lr35902) {
+        cpu_t* cpu = lr35902->cpu;
+
+        if (cpu->read_ongoing) {
+            if (cpu->region == BR_BOOT)
+                bus_set_d(&cpu->bus, bootrom_read(lr35902->boot, cpu->a_latch));
+        } else if (cpu->write_ongoing) {
+            if (cpu->a_latch == 0xff50)
+                bootrom_write(lr35902->boot, cpu->d_latch);
         }
+    }
 
-        cpu_clock(lr35902->cpu);
+    void lr35902_clock(lr35902_t* lr35902, uint64_t now) {
+        cpu_t* cpu = lr35902->cpu;
 
-        // Set external bus depending on whether the last
-        // CPU cycle was an internal or external cycle
-        if (lr35902_is_internal_cycle(lr35902)) {
-            lr35902->ext_bus = &lr35902_idle_ext_bus;
-        } else {
-            lr35902->ext_bus = &lr35902->cpu->bus;
-        }
+        cpu_clock(cpu, now);
+
+        if ((now & (M - 1)) == 2) lr35902_internal_access(lr35902);
+
+        // Output stage, either the CPU's pins or the idle bus
+        uint32_t drive = lr35902_drive_mask(lr35902, now);
+
+        lr35902->ext_bus.pins = (cpu->bus.pins & drive) | (lr35902->idle_bus.pins & ~drive);
+
+        // Let external devices react to whatever changed
+        bus_publish(&lr35902->ext_pub, &lr35902->ext_bus);
+
+        // Whatever a device drove onto D0-D7 (reads) makes it
+        // back to the CPU, on writes this is what the CPU drove
+        uint32_t d = BUS_D & drive;
+
+        cpu->bus.pins = (cpu->bus.pins & ~d) | (lr35902->ext_bus.pins & d);
     }
-}
\ No newline at end of file
+}
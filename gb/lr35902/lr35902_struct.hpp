@@ -9,14 +9,6 @@
 #include "bus_struct.hpp"
 
 namespace gb {
-    bus_t lr35902_idle_ext_bus = {
-        /* a  */ 0x8000,
-        /* d  */ 0xff,
-        /* wr */ true,
-        /* rd */ true,
-        /* cs */ true
-    };
-
     // The LR35902 SoC on the Game Boy contains the CPU (Sharp SM83-like core)
     // the PSG or APU, the Video Generator or PPU, the Serial Controller or SC
     // The CPU drives the A, D, WR, RD and CS lines
@@ -30,7 +22,19 @@ namespace gb {
         bool main_bus_set;
         bool vram_bus_set;
 
-        bus_t* ext_bus = &lr35902_idle_ext_bus;
+        // What the external bus looks like while the CPU is
+        // on an internal cycle, every instance owns its own
+        bus_t idle_bus;
+
+        // Output stage: the pins outside the SoC. Devices wire
+        // themselves to this for good, it's either a copy of the
+        // CPU's pins (external cycle) or idle_bus (internal cycle)
+        bus_t ext_bus;
+
+        // Devices outside the SoC only get clocked when the
+        // external bus pins they're wired to actually toggle.
+        // (The VRAM bus will get its own publisher)
+        bus_publisher_t ext_pub;
 
         struct pins_t {
             uint16_t ma;    // VRAM bus Address     MA0-MA12
@@ -2,4 +2,5 @@
 
 #define RANGE(var, start, end) ((var >= start) && (var <= end))
 #define T 2
-#define M 8
\ No newline at end of file
+#define M 8
+#define FRAME (70224 * T)
\ No newline at end of file
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "macros.hpp"
+#include "log.hpp"
+
+namespace gb {
+    // Thin wrapper over mmap/MapViewOfFile. ROMs are mapped
+    // read-only, so every instance running the same image
+    // shares the same page cache pages instead of a copy.
+    // Saves are mapped read-write, writes land directly in
+    // the mapping and get flushed in batches
+    struct mapped_file_t {
+        uint8_t* data;
+        size_t size;
+        bool writable;
+
+#ifdef _WIN32
+        HANDLE file;
+        HANDLE mapping;
+#else
+        int fd;
+#endif
+    };
+
+    void mapped_file_reset(mapped_file_t* f) {
+        std::memset(f, 0, sizeof(mapped_file_t));
+
+#ifdef _WIN32
+        f->file = INVALID_HANDLE_VALUE;
+#else
+        f->fd = -1;
+#endif
+    }
+
+    // Schedule dirty pages for writeback, or wait for
+    // them to hit the disk when `wait` is set
+    void mapped_file_sync(mapped_file_t* f, bool wait) {
+        if (!f->data || !f->writable) return;
+
+#ifdef _WIN32
+        FlushViewOfFile(f->data, f->size);
+
+        if (wait) FlushFileBuffers(f->file);
+#else
+        msync(f->data, f->size, wait ? MS_SYNC : MS_ASYNC);
+#endif
+    }
+
+    // Hint that the mapping will be read front to back once,
+    // so the kernel reads ahead and drops pages behind
+    void mapped_file_sequential(mapped_file_t* f) {
+        if (!f->data) return;
+
+#ifndef _WIN32
+        madvise(f->data, f->size, MADV_SEQUENTIAL);
+#endif
+    }
+
+    void mapped_file_close(mapped_file_t* f) {
+        mapped_file_sync(f, true);
+
+#ifdef _WIN32
+        if (f->data) UnmapViewOfFile(f->data);
+        if (f->mapping) CloseHandle(f->mapping);
+        if (f->file != INVALID_HANDLE_VALUE) CloseHandle(f->file);
+#else
+        if (f->data) munmap(f->data, f->size);
+        if (f->fd >= 0) ::close(f->fd);
+#endif
+
+        mapped_file_reset(f);
+    }
+
+    // Map an existing file read-only
+    bool mapped_file_open(mapped_file_t* f, const char* path) {
+        mapped_file_reset(f);
+
+#ifdef _WIN32
+        f->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        if (f->file == INVALID_HANDLE_VALUE) {
+            _logc(file, error, "Couldn't open \"%s\"", path);
+
+            return false;
+        }
+
+        LARGE_INTEGER size;
+
+        GetFileSizeEx(f->file, &size);
+
+        f->size = (size_t)size.QuadPart;
+
+        if (f->size) {
+            f->mapping = CreateFileMappingA(f->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            f->data = f->mapping ? (uint8_t*)MapViewOfFile(f->mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        }
+#else
+        f->fd = ::open(path, O_RDONLY);
+
+        if (f->fd < 0) {
+            _logc(file, error, "Couldn't open \"%s\"", path);
+
+            return false;
+        }
+
+        struct stat st;
+
+        fstat(f->fd, &st);
+
+        f->size = (size_t)st.st_size;
+
+        if (f->size) {
+            void* data = mmap(nullptr, f->size, PROT_READ, MAP_SHARED, f->fd, 0);
+
+            f->data = (data == MAP_FAILED) ? nullptr : (uint8_t*)data;
+        }
+#endif
+
+        if (!f->data) {
+            _logc(file, error, "Couldn't map \"%s\"", path);
+
+            mapped_file_close(f);
+
+            return false;
+        }
+
+        return true;
+    }
+
+    // Map a file read-write, creating it (zero filled)
+    // or growing it to `size` bytes if needed
+    bool mapped_file_create(mapped_file_t* f, const char* path, size_t size) {
+        mapped_file_reset(f);
+
+        f->size = size;
+        f->writable = true;
+
+#ifdef _WIN32
+        f->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        if (f->file == INVALID_HANDLE_VALUE) {
+            _logc(file, error, "Couldn't open \"%s\"", path);
+
+            return false;
+        }
+
+        // Grows the file if it's smaller than the mapping
+        f->mapping = CreateFileMappingA(f->file, nullptr, PAGE_READWRITE, 0, (DWORD)size, nullptr);
+        f->data = f->mapping ? (uint8_t*)MapViewOfFile(f->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size) : nullptr;
+#else
+        f->fd = ::open(path, O_RDWR | O_CREAT, 0644);
+
+        if (f->fd < 0) {
+            _logc(file, error, "Couldn't open \"%s\"", path);
+
+            return false;
+        }
+
+        struct stat st;
+
+        fstat(f->fd, &st);
+
+        if (((size_t)st.st_size < size) && ftruncate(f->fd, size)) {
+            _logc(file, error, "Couldn't grow \"%s\" to %zu bytes", path, size);
+
+            mapped_file_close(f);
+
+            return false;
+        }
+
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, f->fd, 0);
+
+        f->data = (data == MAP_FAILED) ? nullptr : (uint8_t*)data;
+#endif
+
+        if (!f->data) {
+            _logc(file, error, "Couldn't map \"%s\"", path);
+
+            mapped_file_close(f);
+
+            return false;
+        }
+
+        return true;
+    }
+}
\ No newline at end of file
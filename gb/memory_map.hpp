@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "macros.hpp"
+#include "structs.hpp"
+
+namespace gb {
+    // Transaction-level view of the address space, used by
+    // cores that don't care about pins (see cpu_fast_funcs.hpp)
+    //
+    // The map is split into 256 byte pages, pages backed
+    // by plain host memory (ROM, WRAM) are accessed directly
+    // through the page pointers, everything else falls back
+    // to the read/write handlers.
+
+    typedef uint8_t (*mem_read_t)(void*, uint16_t);
+    typedef void (*mem_write_t)(void*, uint16_t, uint8_t);
+
+    struct memory_map_t {
+        const uint8_t* rd[0x100];
+        uint8_t* wr[0x100];
+
+        // Page 0 can be overlaid (the boot ROM), whatever gets
+        // mapped there meanwhile goes underneath, see mem_overlay
+        const uint8_t* overlay;
+        const uint8_t* under_rd;
+        uint8_t* under_wr;
+
+        void* ctx;
+        mem_read_t read;
+        mem_write_t write;
+    };
+
+    uint8_t mem_open_bus_read(void* ctx, uint16_t addr) {
+        return 0xff;
+    }
+
+    void mem_open_bus_write(void* ctx, uint16_t addr, uint8_t data) {
+        // Nobody is listening
+    }
+
+    void mem_init(memory_map_t* map) {
+        std::memset(map, 0, sizeof(memory_map_t));
+
+        map->read = mem_open_bus_read;
+        map->write = mem_open_bus_write;
+    }
+
+    // Map [start, end] (inclusive, page aligned) to host memory,
+    // pass nullptr to leave either direction to the handlers
+    void mem_map(memory_map_t* map, uint16_t start, uint16_t end, const uint8_t* rd, uint8_t* wr) {
+        for (int page = start >> 8; page <= (end >> 8); page++) {
+            int offset = (page << 8) - start;
+
+            if (!page && map->overlay) {
+                map->under_rd = rd ? rd + offset : nullptr;
+                map->under_wr = wr ? wr + offset : nullptr;
+
+                continue;
+            }
+
+            map->rd[page] = rd ? rd + offset : nullptr;
+            map->wr[page] = wr ? wr + offset : nullptr;
+        }
+    }
+
+    void mem_unmap(memory_map_t* map, uint16_t start, uint16_t end) {
+        mem_map(map, start, end, nullptr, nullptr);
+    }
+
+    // Lay read-only `rd` over page 0, nullptr lifts it and
+    // brings back whatever is mapped underneath. Writes to
+    // an overlaid page go to the handlers
+    void mem_overlay(memory_map_t* map, const uint8_t* rd) {
+        if (rd && !map->overlay) {
+            map->under_rd = map->rd[0];
+            map->under_wr = map->wr[0];
+        }
+
+        if (!rd && map->overlay) {
+            map->rd[0] = map->under_rd;
+            map->wr[0] = map->under_wr;
+        }
+
+        map->overlay = rd;
+
+        if (rd) {
+            map->rd[0] = rd;
+            map->wr[0] = nullptr;
+        }
+    }
+
+    inline uint8_t mem_read(memory_map_t* map, uint16_t addr) {
+        const uint8_t* page = map->rd[addr >> 8];
+
+        if (page) return page[addr & 0xff];
+
+        return map->read(map->ctx, addr);
+    }
+
+    inline void mem_write(memory_map_t* map, uint16_t addr, uint8_t data) {
+        uint8_t* page = map->wr[addr >> 8];
+
+        if (page) {
+            page[addr & 0xff] = data;
+
+            return;
+        }
+
+        map->write(map->ctx, addr, data);
+    }
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+#include "../macros.hpp"
+#include "../structs.hpp"
+#include "../log.hpp"
+
+#include "../gameboy.hpp"
+
+#include "multi_struct.hpp"
+#include "multi_funcs.hpp"
+
+// Differential check of the lock-step engine: MULTI_LANES instances
+// of the same ROM go through multi_run, and a twin of each goes
+// through run_fast. Lanes are pulled apart a little more every round
+// so they diverge and regroup. After every round, each lane must
+// match its twin: registers, flags, WRAM and the master clock.
+//
+// Any ROM works, the kernels only get a real workout from code that
+// is mostly register ops mixed with (hl) accesses and relative jumps.
+
+namespace gb {
+    struct multi_check_state_t {
+        uint8_t r[8];
+        uint16_t pc, sp;
+        bool ime;
+        uint64_t now;
+    };
+
+    inline void multi_check_capture(gameboy_t* gb, multi_check_state_t* s) {
+        std::memcpy(s->r, gb->cpu.r, sizeof(s->r));
+
+        s->r[6] = cpu_flags(&gb->cpu);
+        s->pc = gb->cpu.pc;
+        s->sp = gb->cpu.sp;
+        s->ime = gb->cpu.ime;
+        s->now = gb->sched.now;
+    }
+
+    void multi_check_print(FILE* out, char sign, const multi_check_state_t* s) {
+        std::fprintf(out, "%c A:%02X F:%02X B:%02X C:%02X D:%02X E:%02X H:%02X L:%02X SP:%04X PC:%04X IME:%u NOW:%llu\n",
+            sign,
+            s->r[7], s->r[6], s->r[0], s->r[1], s->r[2], s->r[3], s->r[4], s->r[5],
+            s->sp, s->pc, s->ime, (unsigned long long)s->now
+        );
+    }
+
+    // Runs `rounds` rounds of `cycles` half cycles each, lanes are
+    // added and removed every round. Prints the first lane that
+    // doesn't match its twin to `out`, returns whether all did
+    bool multi_check(const char* rom, uint64_t cycles, int rounds, FILE* out) {
+        multi_t* m = new multi_t;
+
+        gameboy_t* lane[MULTI_LANES] = {};
+        gameboy_t* twin[MULTI_LANES] = {};
+
+        bool ok = true;
+
+        for (int i = 0; ok && (i < MULTI_LANES); i++) {
+            lane[i] = new gameboy_t;
+            twin[i] = new gameboy_t;
+
+            init(lane[i]);
+            init(twin[i]);
+
+            ok = insert_cartridge(lane[i], rom) && insert_cartridge(twin[i], rom);
+
+            if (!ok) break;
+
+            skip_boot(lane[i]);
+            skip_boot(twin[i]);
+        }
+
+        for (int round = 0; ok && (round < rounds); round++) {
+            // All lanes start the first round in step (dense kernels),
+            // later ones in 4 groups a few instructions apart (grouped
+            // kernels and scalar lanes side by side)
+            for (int i = 0; round && (i < MULTI_LANES); i++) {
+                run_fast(lane[i], (i & 3) * round * M);
+                run_fast(twin[i], (i & 3) * round * M);
+            }
+
+            multi_init(m);
+
+            for (int i = 0; i < MULTI_LANES; i++)
+                multi_add(m, lane[i]);
+
+            multi_run(m, cycles);
+            multi_remove_all(m);
+
+            for (int i = 0; ok && (i < MULTI_LANES); i++) {
+                run_fast(twin[i], cycles);
+
+                multi_check_state_t got, want;
+
+                multi_check_capture(lane[i], &got);
+                multi_check_capture(twin[i], &want);
+
+                bool same = !std::memcmp(&got.r, &want.r, sizeof(got.r)) &&
+                            (got.pc == want.pc) && (got.sp == want.sp) &&
+                            (got.ime == want.ime) && (got.now == want.now);
+
+                bool wram = !std::memcmp(lane[i]->wram.memory, twin[i]->wram.memory, sizeof(lane[i]->wram.memory));
+
+                if (!same || !wram) {
+                    std::fprintf(out, "Lane %d diverged from run_fast in round %d%s\n", i, round + 1, wram ? "" : " (WRAM differs)");
+
+                    multi_check_print(out, '-', &want);
+                    multi_check_print(out, '+', &got);
+
+                    ok = false;
+                }
+            }
+        }
+
+        if (ok) std::fprintf(out, "All %d lanes match run_fast over %d rounds\n", MULTI_LANES, rounds);
+
+        for (int i = 0; i < MULTI_LANES; i++) {
+            if (!lane[i]) break;
+
+            destroy(lane[i]);
+            destroy(twin[i]);
+
+            delete lane[i];
+            delete twin[i];
+        }
+
+        delete m;
+
+        return ok;
+    }
+}
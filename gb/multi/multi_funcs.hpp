@@ -0,0 +1,504 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "../macros.hpp"
+#include "../structs.hpp"
+#include "../memory_map.hpp"
+
+#include "../gameboy.hpp"
+
+#include "multi_struct.hpp"
+
+// Lock-step engine: every step, each lane executes exactly one
+// instruction. Lanes are grouped by opcode, groups running a
+// register-only instruction go through the SoA kernels below
+// (when every lane converged on the same opcode, those are plain
+// loops over contiguous lanes the compiler turns into vector code),
+// everything else runs through the scalar fast core for that lane.
+//
+// Only architectural state lives in the SoA arrays, plus x_latch,
+// which leaks into the flags of inc (hl) and dec (hl). The per-lane
+// cpu_t is used as scratch by the scalar path, so other latches are
+// only meaningful for lanes that last ran a scalar instruction.
+
+namespace gb {
+    uint8_t multi_read(void* ctx, uint16_t addr) {
+        multi_lane_t* l = (multi_lane_t*)ctx;
+
+        if (RANGE(addr, 0xc000, 0xfdff))
+            return l->multi->wram[addr & 0x1fff][l->lane];
+
+        return mem_read(&l->gb->map, addr);
+    }
+
+    // Pick up whatever the instance's map looks like right now
+    // (MBC writes remap ROM banks), minus WRAM
+    void multi_sync_map(multi_lane_t* l) {
+        std::memcpy(l->map.rd, l->gb->map.rd, sizeof(l->map.rd));
+        std::memcpy(l->map.wr, l->gb->map.wr, sizeof(l->map.wr));
+
+        mem_unmap(&l->map, 0xc000, 0xfdff);
+    }
+
+    void multi_write(void* ctx, uint16_t addr, uint8_t data) {
+        multi_lane_t* l = (multi_lane_t*)ctx;
+
+        if (RANGE(addr, 0xc000, 0xfdff)) {
+            l->multi->wram[addr & 0x1fff][l->lane] = data;
+
+            return;
+        }
+
+        mem_write(&l->gb->map, addr, data);
+
+        multi_sync_map(l);
+    }
+
+    void multi_init(multi_t* m) {
+        std::memset(m, 0, sizeof(multi_t));
+    }
+
+    // Move an instance into the next free lane, it must not
+    // be touched until multi_remove. Returns the lane, or -1
+    int multi_add(multi_t* m, gameboy_t* gb) {
+        if (m->count == MULTI_LANES) return -1;
+
+        int i = m->count++;
+
+        multi_lane_t* l = &m->lanes[i];
+
+        l->multi = m;
+        l->gb = gb;
+        l->lane = i;
+
+        mem_init(&l->map);
+
+        l->map.ctx = l;
+        l->map.read = multi_read;
+        l->map.write = multi_write;
+
+        multi_sync_map(l);
+
+        // Same hand-off as run_fast
+        sync(gb);
+
+        scheduler_cancel(&gb->sched, EV_CPU);
+
+        cpu_t* cpu = &gb->cpu;
+
+        m->now[i] = gb->sched.now;
+
+        // Lanes always sit right after an opcode fetch, the
+        // instance's clock catches up at the end of the next run
+        if (cpu->state == ST_FETCH) {
+            cpu->i_latch = mem_read(&gb->map, cpu->pc++);
+            cpu->state = ST_EXECUTE;
+
+            m->now[i] += M;
+        }
+
+        // Lanes keep F in r[6]
+        cpu_flags_sync(cpu);
+
+        for (int r = 0; r < 8; r++)
+            m->r[r][i] = cpu->r[r];
+
+        m->pc[i] = cpu->pc;
+        m->sp[i] = cpu->sp;
+        m->op[i] = cpu->i_latch;
+        m->ime[i] = cpu->ime;
+        m->x_latch[i] = cpu->x_latch;
+
+        for (int a = 0; a < 0x2000; a++)
+            m->wram[a][i] = gb->wram.memory[a];
+
+        return i;
+    }
+
+    // Write every lane back to its instance, pin-level
+    // clocking can be resumed right after
+    void multi_remove_all(multi_t* m) {
+        for (int i = 0; i < m->count; i++) {
+            gameboy_t* gb = m->lanes[i].gb;
+            cpu_t* cpu = &gb->cpu;
+
+            for (int r = 0; r < 8; r++)
+                cpu->r[r] = m->r[r][i];
+
+            cpu->pc = m->pc[i];
+            cpu->sp = m->sp[i];
+            cpu->i_latch = m->op[i];
+            cpu->temp_i_latch = m->op[i];
+            cpu->ime = m->ime[i];
+            cpu->x_latch = m->x_latch[i];
+            cpu->ex_m_cycle = 0;
+            cpu->resume = RS_HANDLER;
+
+            for (int a = 0; a < 0x2000; a++)
+                gb->wram.memory[a] = m->wram[a][i];
+
+            scheduler_schedule(&gb->sched, EV_CPU, gb->sched.now);
+            cpu_update_clocks(cpu, gb->sched.now);
+        }
+
+        m->count = 0;
+    }
+
+    // Instructions that only touch the register file, plus operand
+    // fetches and relative jumps (pc is per lane, the branch is masked)
+    constexpr bool multi_is_vector_op(uint8_t op) {
+        uint8_t x = (op >> 3) & 0x7;
+        uint8_t y = op & 0x7;
+
+        switch (op >> 6) {
+            case 0: {
+                if ((op == 0x00) || (op == 0x2f) || (op == 0x37) || (op == 0x3f))
+                    return true;
+
+                // jr n, jr cc, n
+                if ((op == 0x18) || (op == 0x20) || (op == 0x28) || (op == 0x30) || (op == 0x38))
+                    return true;
+
+                // inc r, dec r, ld r, n
+                return ((y == 4) || (y == 5) || (y == 6)) && (x != 6);
+            }
+
+            // ld r, r (0x76 isn't implemented)
+            case 1: return (x != 6) && (y != 6);
+
+            // alu a, r
+            case 2: return y != 6;
+
+            // alu a, n
+            case 3: return y == 6;
+        }
+
+        return false;
+    }
+
+    // Execute `op` on n lanes, either lanes 0..n-1 (dense) or the
+    // ones listed in idx. Must match the fast handlers bit for bit
+    template <bool dense> void multi_exec_vector(multi_t* m, uint8_t op, const uint8_t* idx, int n) {
+        uint8_t x = (op >> 3) & 0x7;
+        uint8_t y = op & 0x7;
+
+        uint8_t* a = m->r[7];
+        uint8_t* f = m->r[6];
+        uint8_t* rx = m->r[x];
+
+        // Extra M cycles (before LAST) taken by each lane
+        uint8_t cycles[MULTI_LANES];
+
+        // Immediate operand, for the instructions that have one
+        uint8_t imm[MULTI_LANES];
+
+        bool has_imm = ((op >> 6) == 3) || (((op >> 6) == 0) && ((y == 6) || (y == 0)) && op);
+
+        #define LANE (dense ? k : idx[k])
+
+        for (int k = 0; k < n; k++) {
+            int i = LANE;
+
+            cycles[i] = has_imm ? 1 : 0;
+
+            if (has_imm) imm[i] = mem_read(&m->lanes[i].map, m->pc[i]++);
+        }
+
+        // Second operand of alu ops
+        const uint8_t* src = has_imm ? imm : m->r[y];
+
+        switch (op >> 6) {
+            case 0: {
+                if (!op) {
+                    // nop
+                } else if (op == 0x2f) {
+                    for (int k = 0; k < n; k++) a[LANE] ^= 0xff;
+                } else if (op == 0x37) {
+                    for (int k = 0; k < n; k++) f[LANE] |= 0x10;
+                } else if (op == 0x3f) {
+                    // Matches fast_ccf
+                    for (int k = 0; k < n; k++) f[LANE] &= ~0x10;
+                } else if (op == 0x18) {
+                    for (int k = 0; k < n; k++) {
+                        int i = LANE;
+
+                        m->pc[i] += (int8_t)imm[i];
+                        cycles[i] = 2;
+                    }
+                } else if (y == 0) {
+                    // jr cc, taken on lanes where the flag matches
+                    uint8_t flag = (x & 0x2) ? 0x10 : 0x80;
+                    uint8_t want = (x & 0x1) ? flag : 0;
+
+                    for (int k = 0; k < n; k++) {
+                        int i = LANE;
+                        bool taken = (f[i] & flag) == want;
+
+                        m->pc[i] += taken ? (int8_t)imm[i] : 0;
+                        cycles[i] = taken ? 2 : 1;
+                    }
+                } else if (y == 4) {
+                    for (int k = 0; k < n; k++) {
+                        int i = LANE;
+                        uint8_t v = rx[i] + 1;
+
+                        rx[i] = v;
+                        m->x_latch[i] = x;
+                        f[i] = (f[i] & 0x1f) | (v ? 0 : 0x80) | ((((v & 0xf) + 1) & 0xf0) ? 0x20 : 0);
+                    }
+                } else if (y == 5) {
+                    for (int k = 0; k < n; k++) {
+                        int i = LANE;
+                        uint8_t v = rx[i] - 1;
+
+                        rx[i] = v;
+                        m->x_latch[i] = x;
+                        f[i] = (f[i] & 0x1f) | (v ? 0 : 0x80) | ((((v & 0xf) + 1) & 0xf0) ? 0x20 : 0);
+                    }
+                } else if (y == 6) {
+                    for (int k = 0; k < n; k++) {
+                        int i = LANE;
+
+                        rx[i] = imm[i];
+                        m->x_latch[i] = x;
+                    }
+                }
+            } break;
+
+            case 1: {
+                const uint8_t* ry = m->r[y];
+
+                for (int k = 0; k < n; k++) {
+                    int i = LANE;
+
+                    rx[i] = ry[i];
+                    m->x_latch[i] = x;
+                }
+            } break;
+
+            case 2: case 3: {
+                bool carry = op & 0x8;
+
+                switch (x) {
+                    // add, adc
+                    case 0: case 1: {
+                        for (int k = 0; k < n; k++) {
+                            int i = LANE;
+                            uint8_t s = src[i];
+                            uint16_t res = a[i] + s + ((carry && (f[i] & 0x10)) ? 1 : 0);
+
+                            f[i] = (f[i] & 0x0f) |
+                                   ((res > 0xff) ? 0x10 : 0) |
+                                   ((res & 0xff) ? 0 : 0x80) |
+                                   ((((a[i] & 0xf) + (s & 0xf)) & 0xf0) ? 0x20 : 0);
+
+                            a[i] = res;
+                        }
+                    } break;
+
+                    // sub, sbc and cp, carry out of a signed
+                    // result is never set (same as sub8/cp8)
+                    case 2: case 3: case 7: {
+                        bool store = x != 7;
+
+                        if (x == 7) carry = false;
+
+                        for (int k = 0; k < n; k++) {
+                            int i = LANE;
+                            uint8_t res = a[i] - src[i] - ((carry && (f[i] & 0x10)) ? 1 : 0);
+
+                            f[i] = (f[i] & 0x2f) | 0x40 | (res ? 0 : 0x80);
+
+                            if (store) a[i] = res;
+                        }
+                    } break;
+
+                    // and, or, xor: CLEAR_FLAGS(NF | CF ...) expands to
+                    // F &= ~NF | CF ... in the scalar helpers, so only N
+                    // actually gets cleared, C and H are left alone
+                    case 4: {
+                        for (int k = 0; k < n; k++) {
+                            int i = LANE;
+                            uint8_t res = a[i] & src[i];
+
+                            f[i] = (f[i] & 0x3f) | 0x20 | (res ? 0 : 0x80);
+                            a[i] = res;
+                        }
+                    } break;
+
+                    // 0xa8-0xaf are wired to or, 0xb0-0xb7 to xor
+                    case 5: {
+                        for (int k = 0; k < n; k++) {
+                            int i = LANE;
+                            uint8_t res = a[i] | src[i];
+
+                            f[i] = (f[i] & 0x3f) | (res ? 0 : 0x80);
+                            a[i] = res;
+                        }
+                    } break;
+
+                    case 6: {
+                        for (int k = 0; k < n; k++) {
+                            int i = LANE;
+                            uint8_t res = a[i] ^ src[i];
+
+                            f[i] = (f[i] & 0x3f) | (res ? 0 : 0x80);
+                            a[i] = res;
+                        }
+                    } break;
+                }
+            } break;
+        }
+
+        // LAST cycle, fetch the next opcode
+        for (int k = 0; k < n; k++) {
+            int i = LANE;
+
+            m->op[i] = mem_read(&m->lanes[i].map, m->pc[i]++);
+            m->now[i] += (cycles[i] + 1) * M;
+        }
+
+        #undef LANE
+    }
+
+    // Run a single lane through the scalar fast core, for up to
+    // `steps` instructions or until its clock reaches `until`
+    void multi_exec_scalar(multi_t* m, int i, int steps, uint64_t until) {
+        cpu_t* cpu = &m->lanes[i].gb->cpu;
+
+        for (int r = 0; r < 8; r++)
+            cpu->r[r] = m->r[r][i];
+
+        cpu->pc = m->pc[i];
+        cpu->sp = m->sp[i];
+        cpu->i_latch = m->op[i];
+        cpu->ime = m->ime[i];
+        cpu->x_latch = m->x_latch[i];
+
+        // Cycles are accounted for once the run ends
+        uint64_t t = cpu->total_t_cycles;
+
+        do {
+            m->now[i] += cpu_fast_step(cpu, &m->lanes[i].map) * M;
+        } while ((--steps > 0) && (m->now[i] < until));
+
+        cpu->total_t_cycles = t;
+
+        cpu_flags_sync(cpu);
+
+        for (int r = 0; r < 8; r++)
+            m->r[r][i] = cpu->r[r];
+
+        m->pc[i] = cpu->pc;
+        m->sp[i] = cpu->sp;
+        m->op[i] = cpu->i_latch;
+        m->ime[i] = cpu->ime;
+        m->x_latch[i] = cpu->x_latch;
+    }
+
+    // Run every lane for at least `cycles` half cycles,
+    // stopping on the first instruction boundary after that
+    void multi_run(multi_t* m, uint64_t cycles) {
+        uint64_t until[MULTI_LANES];
+
+        for (int i = 0; i < m->count; i++)
+            until[i] = m->lanes[i].gb->sched.now + cycles;
+
+        uint8_t active[MULTI_LANES];
+
+        // Lanes grouped by opcode, as linked lists
+        int head[0x100];
+        int next[MULTI_LANES];
+
+        std::memset(head, -1, sizeof(head));
+
+        while (true) {
+            int n = 0;
+
+            for (int i = 0; i < m->count; i++)
+                if (m->now[i] < until[i]) active[n++] = i;
+
+            if (!n) break;
+
+            // Fast path, every lane is on the same opcode
+            if (n == m->count) {
+                bool converged = true;
+
+                for (int i = 1; i < n; i++)
+                    converged &= m->op[i] == m->op[0];
+
+                if (converged) {
+                    if (multi_is_vector_op(m->op[0])) {
+                        multi_exec_vector<true>(m, m->op[0], nullptr, n);
+                    } else {
+                        for (int i = 0; i < n; i++)
+                            multi_exec_scalar(m, i, 1, until[i]);
+                    }
+
+                    continue;
+                }
+            }
+
+            // Diverged, regroup lanes by opcode
+            int groups = 0;
+
+            for (int k = n - 1; k >= 0; k--) {
+                int i = active[k];
+
+                groups += head[m->op[i]] < 0;
+
+                next[i] = head[m->op[i]];
+                head[m->op[i]] = i;
+            }
+
+            // Too few lanes share an opcode for the kernels to pay
+            // off, let every lane run on its own for a while before
+            // checking whether they converged again
+            if (groups > (n / 2)) {
+                for (int k = 0; k < n; k++) {
+                    int i = active[k];
+
+                    head[m->op[i]] = -1;
+
+                    multi_exec_scalar(m, i, MULTI_DIVERGED_STEPS, until[i]);
+                }
+
+                continue;
+            }
+
+            for (int k = 0; k < n; k++) {
+                uint8_t op = m->op[active[k]];
+
+                if (head[op] < 0) continue;
+
+                uint8_t group[MULTI_LANES];
+                int size = 0;
+
+                for (int i = head[op]; i >= 0; i = next[i])
+                    group[size++] = i;
+
+                head[op] = -1;
+
+                if (multi_is_vector_op(op)) {
+                    multi_exec_vector<false>(m, op, group, size);
+                } else {
+                    for (int g = 0; g < size; g++)
+                        multi_exec_scalar(m, group[g], 1, until[group[g]]);
+                }
+            }
+        }
+
+        // Let each instance catch up on its own events
+        for (int i = 0; i < m->count; i++) {
+            gameboy_t* gb = m->lanes[i].gb;
+
+            gb->cpu.total_t_cycles += (m->now[i] - gb->sched.now) / T;
+            gb->sched.now = m->now[i];
+
+            if (scheduler_due(&gb->sched, gb->sched.now))
+                scheduler_run(&gb->sched, gb->sched.now);
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../macros.hpp"
+#include "../structs.hpp"
+#include "../memory_map.hpp"
+
+// 16 lanes of byte registers fill one SSE register, bump to
+// 32 or 64 to fill a whole AVX2 or AVX-512 one
+#ifndef MULTI_LANES
+#define MULTI_LANES 16
+#endif
+
+// Instructions each lane runs on its own once lanes diverge
+#ifndef MULTI_DIVERGED_STEPS
+#define MULTI_DIVERGED_STEPS 64
+#endif
+
+namespace gb {
+    struct gameboy_t;
+    struct multi_t;
+
+    // Per-lane view of memory, WRAM pages are routed into the
+    // interleaved array, everything else goes to the lane's instance
+    struct multi_lane_t {
+        multi_t* multi;
+        gameboy_t* gb;
+        int lane;
+
+        memory_map_t map;
+    };
+
+    // Structure-of-arrays counterpart of cpu_t + WRAM for up to
+    // MULTI_LANES instances running the same ROM in lock-step.
+    //
+    // Everything is lane-minor: r[7] holds A for every lane, and
+    // wram[addr] holds the byte at addr for every lane, so an
+    // instruction executed by all lanes touches whole vectors.
+    struct multi_t {
+        // Architectural CPU state
+        alignas(64) uint8_t r[8][MULTI_LANES];
+        alignas(64) uint16_t pc[MULTI_LANES];
+        alignas(64) uint16_t sp[MULTI_LANES];
+        alignas(64) uint8_t op[MULTI_LANES];    // Next opcode (i_latch)
+        alignas(64) bool ime[MULTI_LANES];
+
+        // inc (hl) and dec (hl) take their flags from r[x_latch],
+        // left over from the last instruction that latched it
+        alignas(64) uint8_t x_latch[MULTI_LANES];
+
+        // Master timestamp of each lane, in half cycles
+        alignas(64) uint64_t now[MULTI_LANES];
+
+        alignas(64) uint8_t wram[0x2000][MULTI_LANES];
+
+        multi_lane_t lanes[MULTI_LANES];
+        int count;
+    };
+}
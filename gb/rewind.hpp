@@ -0,0 +1,292 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#include "macros.hpp"
+#include "structs.hpp"
+#include "log.hpp"
+
+#include "gameboy.hpp"
+#include "state.hpp"
+
+// Rolling history of save states, one per frame.
+// Every `interval` frames a keyframe is stored, frames in between
+// are stored as the XOR of their state against that keyframe, which
+// is almost all zeroes, and then run-length compressed.
+//
+// Compressed frames live in a byte ring, the oldest keyframe and all
+// frames depending on it are dropped together when space runs out.
+// If that's the keyframe the new frame would refer to, the new frame
+// is stored as a keyframe instead.
+
+namespace gb {
+    struct rewind_entry_t {
+        size_t offset;
+        size_t size;
+        bool keyframe;
+    };
+
+    struct rewind_t {
+        size_t state_size;
+
+        // Keyframe every `interval` frames
+        uint32_t interval;
+        uint32_t since_key;
+
+        // Ring of compressed frames
+        rewind_entry_t* entries;
+        uint32_t capacity;
+        uint32_t first;
+        uint32_t count;
+
+        uint8_t* data;
+        size_t data_size;
+        size_t head;        // Next free byte
+
+        // State of the keyframe the newest frame refers to
+        uint8_t* key;
+
+        // Scratch buffers
+        uint8_t* cur;
+        uint8_t* enc;
+    };
+
+    // Worst case: alternating single zero/non-zero bytes
+    inline size_t rewind_max_encoded(size_t size) {
+        return size * 2 + 16;
+    }
+
+    inline uint8_t* rewind_put_varint(uint8_t* p, size_t v) {
+        while (v >= 0x80) {
+            *p++ = (v & 0x7f) | 0x80;
+            v >>= 7;
+        }
+
+        *p++ = v;
+
+        return p;
+    }
+
+    inline const uint8_t* rewind_get_varint(const uint8_t* p, size_t* v) {
+        size_t r = 0;
+        int shift = 0;
+
+        do {
+            r |= (size_t)(*p & 0x7f) << shift;
+            shift += 7;
+        } while (*p++ & 0x80);
+
+        *v = r;
+
+        return p;
+    }
+
+    // Encode `a ^ b` (or just `a` if b is null) as a sequence of
+    // [zero run][literal count][literals], returns encoded size
+    size_t rewind_encode(const uint8_t* a, const uint8_t* b, size_t size, uint8_t* out) {
+        uint8_t* p = out;
+        size_t i = 0;
+
+        while (i < size) {
+            size_t zeroes = 0;
+
+            while ((i < size) && !(a[i] ^ (b ? b[i] : 0))) {
+                zeroes++;
+                i++;
+            }
+
+            // Literals run until at least two zero bytes in a row
+            size_t start = i;
+
+            while (i < size) {
+                uint8_t x = a[i] ^ (b ? b[i] : 0);
+
+                if (!x && ((i + 1 >= size) || !(a[i + 1] ^ (b ? b[i + 1] : 0))))
+                    break;
+
+                i++;
+            }
+
+            p = rewind_put_varint(p, zeroes);
+            p = rewind_put_varint(p, i - start);
+
+            for (size_t j = start; j < i; j++) {
+                *p++ = a[j] ^ (b ? b[j] : 0);
+            }
+        }
+
+        return p - out;
+    }
+
+    // Inverse of the above, XORs into `out` (which must hold the
+    // keyframe, or zeroes)
+    void rewind_decode(const uint8_t* in, size_t in_size, uint8_t* out) {
+        const uint8_t* end = in + in_size;
+        size_t i = 0;
+
+        while (in < end) {
+            size_t zeroes, literals;
+
+            in = rewind_get_varint(in, &zeroes);
+            in = rewind_get_varint(in, &literals);
+
+            i += zeroes;
+
+            for (size_t j = 0; j < literals; j++) {
+                out[i++] ^= *in++;
+            }
+        }
+    }
+
+    // Keep up to `frames` frames within `budget` bytes of compressed data
+    void rewind_init(rewind_t* rw, gameboy_t* gb, uint32_t frames, uint32_t interval, size_t budget) {
+        std::memset(rw, 0, sizeof(rewind_t));
+
+        rw->state_size = state_size(gb);
+        rw->interval = interval;
+        rw->since_key = interval;
+
+        rw->capacity = frames;
+        rw->entries = new rewind_entry_t[frames];
+
+        // A keyframe must always fit
+        rw->data_size = budget > rewind_max_encoded(rw->state_size) ? budget : rewind_max_encoded(rw->state_size);
+        rw->data = new uint8_t[rw->data_size];
+
+        rw->key = new uint8_t[rw->state_size];
+        rw->cur = new uint8_t[rw->state_size];
+        rw->enc = new uint8_t[rewind_max_encoded(rw->state_size)];
+    }
+
+    void rewind_free(rewind_t* rw) {
+        delete[] rw->entries;
+        delete[] rw->data;
+        delete[] rw->key;
+        delete[] rw->cur;
+        delete[] rw->enc;
+
+        std::memset(rw, 0, sizeof(rewind_t));
+    }
+
+    inline rewind_entry_t* rewind_entry(rewind_t* rw, uint32_t i) {
+        return &rw->entries[(rw->first + i) % rw->capacity];
+    }
+
+    // Drop the oldest keyframe along with every frame depending on it
+    void rewind_evict_group(rewind_t* rw) {
+        do {
+            rw->first = (rw->first + 1) % rw->capacity;
+            rw->count--;
+        } while (rw->count && !rewind_entry(rw, 0)->keyframe);
+    }
+
+    // Do [offset, offset + size) and the oldest frame's bytes overlap?
+    bool rewind_oldest_overlaps(rewind_t* rw, size_t offset, size_t size) {
+        rewind_entry_t* e = rewind_entry(rw, 0);
+
+        return (e->offset < offset + size) && (offset < e->offset + e->size);
+    }
+
+    // Where a frame of `size` bytes goes, wrapping around
+    // instead of splitting it
+    inline size_t rewind_place(rewind_t* rw, size_t size) {
+        return (rw->head + size > rw->data_size) ? 0 : rw->head;
+    }
+
+    // Record the current state, call once per frame
+    void rewind_push(rewind_t* rw, gameboy_t* gb) {
+        save_state(gb, rw->cur, rw->state_size);
+
+        bool keyframe = rw->since_key >= rw->interval;
+        size_t size = rewind_encode(rw->cur, keyframe ? nullptr : rw->key, rw->state_size, rw->enc);
+        size_t offset = rewind_place(rw, size);
+
+        // Make room. The newest keyframe heads the last `since_key`
+        // frames, once it's the oldest one left, a delta against it
+        // would outlive it, so this frame becomes a keyframe instead
+        while (rw->count && ((rw->count == rw->capacity) || rewind_oldest_overlaps(rw, offset, size))) {
+            if (!keyframe && (rw->since_key >= rw->count)) {
+                keyframe = true;
+                size = rewind_encode(rw->cur, nullptr, rw->state_size, rw->enc);
+                offset = rewind_place(rw, size);
+
+                continue;
+            }
+
+            rewind_evict_group(rw);
+        }
+
+        if (keyframe) {
+            std::memcpy(rw->key, rw->cur, rw->state_size);
+
+            rw->since_key = 0;
+        }
+
+        rw->since_key++;
+
+        std::memcpy(rw->data + offset, rw->enc, size);
+
+        rewind_entry_t* e = rewind_entry(rw, rw->count++);
+
+        e->offset = offset;
+        e->size = size;
+        e->keyframe = keyframe;
+
+        rw->head = offset + size;
+    }
+
+    // Restore the newest recorded frame and drop it from the history,
+    // returns false if there's nothing left to rewind to
+    bool rewind_pop(rewind_t* rw, gameboy_t* gb) {
+        if (!rw->count) return false;
+
+        rewind_entry_t* e = rewind_entry(rw, --rw->count);
+
+        if (e->keyframe) {
+            std::memset(rw->cur, 0, rw->state_size);
+
+            // If it was the last one, start over with a fresh keyframe
+            rw->since_key = rw->interval;
+        } else {
+            std::memcpy(rw->cur, rw->key, rw->state_size);
+
+            rw->since_key--;
+        }
+
+        rewind_decode(rw->data + e->offset, e->size, rw->cur);
+
+        rw->head = e->offset;
+
+        // Stepped back past a keyframe, the frames left now
+        // refer to the one before it (the oldest frame always
+        // is a keyframe, the search stops there regardless)
+        if (e->keyframe && rw->count) {
+            uint32_t i = rw->count - 1;
+
+            while (i && !rewind_entry(rw, i)->keyframe) i--;
+
+            rewind_entry_t* k = rewind_entry(rw, i);
+
+            std::memset(rw->key, 0, rw->state_size);
+
+            rewind_decode(rw->data + k->offset, k->size, rw->key);
+
+            rw->since_key = rw->count - i;
+        }
+
+        return load_state(gb, rw->cur, rw->state_size);
+    }
+
+    // Bytes of compressed history currently held
+    size_t rewind_used(rewind_t* rw) {
+        size_t used = 0;
+
+        for (uint32_t i = 0; i < rw->count; i++) {
+            used += rewind_entry(rw, i)->size;
+        }
+
+        return used;
+    }
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "../macros.hpp"
+#include "../structs.hpp"
+
+#include "scheduler_struct.hpp"
+
+namespace gb {
+    void scheduler_init(scheduler_t* s) {
+        std::memset(s, 0, sizeof(scheduler_t));
+
+        for (int i = 0; i < EV_COUNT; i++)
+            s->pos[i] = -1;
+    }
+
+    void scheduler_register(scheduler_t* s, event_id_t id, event_handler_t handler, void* ctx) {
+        s->handler[id] = handler;
+        s->ctx[id] = ctx;
+    }
+
+    inline bool scheduler_before(scheduler_t* s, uint8_t a, uint8_t b) {
+        if (s->when[a] != s->when[b])
+            return s->when[a] < s->when[b];
+
+        return a < b;
+    }
+
+    inline void scheduler_swap(scheduler_t* s, int i, int j) {
+        uint8_t t = s->heap[i];
+
+        s->heap[i] = s->heap[j];
+        s->heap[j] = t;
+
+        s->pos[s->heap[i]] = i;
+        s->pos[s->heap[j]] = j;
+    }
+
+    void scheduler_sift_up(scheduler_t* s, int i) {
+        while (i) {
+            int parent = (i - 1) >> 1;
+
+            if (!scheduler_before(s, s->heap[i], s->heap[parent]))
+                break;
+
+            scheduler_swap(s, i, parent);
+
+            i = parent;
+        }
+    }
+
+    void scheduler_sift_down(scheduler_t* s, int i) {
+        while (true) {
+            int l = (i << 1) + 1, r = l + 1, min = i;
+
+            if (l < s->size && scheduler_before(s, s->heap[l], s->heap[min])) min = l;
+            if (r < s->size && scheduler_before(s, s->heap[r], s->heap[min])) min = r;
+
+            if (min == i)
+                break;
+
+            scheduler_swap(s, i, min);
+
+            i = min;
+        }
+    }
+
+    // (Re)schedule a component's next interesting edge,
+    // replaces any edge previously registered for it
+    void scheduler_schedule(scheduler_t* s, event_id_t id, uint64_t when) {
+        s->when[id] = when;
+
+        if (s->pos[id] < 0) {
+            s->pos[id] = s->size;
+            s->heap[s->size++] = id;
+
+            scheduler_sift_up(s, s->pos[id]);
+        } else {
+            scheduler_sift_up(s, s->pos[id]);
+            scheduler_sift_down(s, s->pos[id]);
+        }
+    }
+
+    void scheduler_cancel(scheduler_t* s, event_id_t id) {
+        int i = s->pos[id];
+
+        if (i < 0) return;
+
+        scheduler_swap(s, i, --s->size);
+
+        s->pos[id] = -1;
+
+        if (i < s->size) {
+            scheduler_sift_up(s, i);
+            scheduler_sift_down(s, i);
+        }
+    }
+
+    // Is any event pending before `t`?
+    inline bool scheduler_due(scheduler_t* s, uint64_t t) {
+        return s->size && (s->when[s->heap[0]] < t);
+    }
+
+    // Dispatch every event before `until`, jumping straight
+    // from one edge to the next. Handlers may schedule new
+    // events, including at the current timestamp
+    void scheduler_run(scheduler_t* s, uint64_t until) {
+        while (scheduler_due(s, until)) {
+            uint8_t id = s->heap[0];
+
+            s->now = s->when[id];
+
+            scheduler_cancel(s, (event_id_t)id);
+
+            s->handler[id](s->ctx[id], s->now);
+        }
+
+        s->now = until;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../macros.hpp"
+#include "../structs.hpp"
+
+namespace gb {
+    // Every component owns exactly one event slot, ties on the
+    // same timestamp are resolved in this order
+    enum event_id_t {
+        EV_CPU,         // LR35902 SoC (CPU) edges
+        EV_FRAME,       // Frame boundary housekeeping (save flushing)
+        EV_COUNT
+    };
+
+    typedef void (*event_handler_t)(void*, uint64_t);
+
+    struct scheduler_t {
+        // Master timestamp, in half cycles since power on
+        uint64_t now;
+
+        // Indexed binary min-heap of pending events
+        uint64_t when[EV_COUNT];
+        int pos[EV_COUNT];      // Position in heap, -1 if not pending
+        uint8_t heap[EV_COUNT];
+        int size;
+
+        event_handler_t handler[EV_COUNT];
+        void* ctx[EV_COUNT];
+    };
+}
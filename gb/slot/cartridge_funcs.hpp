@@ -0,0 +1,259 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "../macros.hpp"
+#include "../structs.hpp"
+#include "../log.hpp"
+#include "../mapped_file.hpp"
+
+#include "cartridge_struct.hpp"
+
+namespace gb {
+    // Recompute the host pointers for both ROM windows,
+    // this is the only place bank numbers get resolved
+    void cartridge_update_banks(cartridge_t* cart) {
+        uint32_t lo = 0, hi = 1;
+
+        switch (cart->mbc) {
+            case MBC_NONE: break;
+
+            case MBC_1: {
+                // In mode 1 the upper bits also apply to 0000-3fff
+                uint32_t upper = (cart->ram_bank & 0x3) << 5;
+
+                lo = cart->mode ? upper : 0;
+                hi = upper | (cart->rom_bank & 0x1f);
+            } break;
+
+            case MBC_3: {
+                hi = cart->rom_bank & 0x7f;
+            } break;
+
+            case MBC_5: {
+                hi = cart->rom_bank & 0x1ff;
+            } break;
+        }
+
+        cart->bank[0] = cart->rom + (lo % cart->rom_banks) * 0x4000;
+        cart->bank[1] = cart->rom + (hi % cart->rom_banks) * 0x4000;
+
+        // Same for the RAM window
+        uint32_t ram = 0;
+
+        switch (cart->mbc) {
+            case MBC_NONE: break;
+            case MBC_1: ram = cart->mode ? (cart->ram_bank & 0x3) : 0; break;
+            case MBC_3: ram = cart->ram_bank; break;
+            case MBC_5: ram = cart->ram_bank & 0xf; break;
+        }
+
+        bool rtc_selected = (cart->mbc == MBC_3) && (ram > 3);
+
+        if (cart->ram && cart->ram_enable && !rtc_selected) {
+            cart->ram_window = cart->ram + ((ram * 0x2000) % cart->ram_size);
+        } else {
+            cart->ram_window = nullptr;
+        }
+    }
+
+    // "game.gb" -> "game.sav"
+    std::string cartridge_save_path(const char* path) {
+        std::string sav = path;
+
+        size_t dot = sav.find_last_of('.');
+        size_t sep = sav.find_last_of("/\\");
+
+        if ((dot != std::string::npos) && ((sep == std::string::npos) || (dot > sep)))
+            sav.erase(dot);
+
+        return sav + ".sav";
+    }
+
+    // `buffer` holds CART_RAM_MAX bytes, used when RAM isn't battery backed
+    bool cartridge_init_ram(cartridge_t* cart, const char* path, uint8_t* buffer) {
+        if (!cart->ram_size) return true;
+
+        if (cart->battery) {
+            std::string sav = cartridge_save_path(path);
+
+            if (!mapped_file_create(&cart->ram_file, sav.c_str(), cart->ram_size))
+                return false;
+
+            cart->ram = cart->ram_file.data;
+        } else {
+            cart->ram = buffer;
+
+            std::memset(cart->ram, 0, cart->ram_size);
+        }
+
+        return true;
+    }
+
+    bool cartridge_load(cartridge_t* cart, const char* path, uint8_t* ram_buffer) {
+        std::memset(cart, 0, sizeof(cartridge_t));
+
+        mapped_file_reset(&cart->ram_file);
+
+        if (!mapped_file_open(&cart->rom_file, path))
+            return false;
+
+        if (cart->rom_file.size < 0x8000) {
+            _logc(slot, error, "\"%s\" is too small to be a Game Boy ROM", path);
+
+            mapped_file_close(&cart->rom_file);
+
+            return false;
+        }
+
+        cart->rom = cart->rom_file.data;
+
+        // Trust the file over the header, some images are trimmed
+        cart->rom_banks = cart->rom_file.size / 0x4000;
+
+        cart->type = cart->rom[0x147];
+
+        switch (cart->type) {
+            case 0x00: cart->mbc = MBC_NONE; break;
+            case 0x01: cart->mbc = MBC_1; break;
+            case 0x02: cart->mbc = MBC_1; break;
+            case 0x03: cart->mbc = MBC_1; cart->battery = true; break;
+            case 0x08: cart->mbc = MBC_NONE; break;
+            case 0x09: cart->mbc = MBC_NONE; cart->battery = true; break;
+            case 0x0f: cart->mbc = MBC_3; cart->battery = true; cart->rtc = true; break;
+            case 0x10: cart->mbc = MBC_3; cart->battery = true; cart->rtc = true; break;
+            case 0x11: cart->mbc = MBC_3; break;
+            case 0x12: cart->mbc = MBC_3; break;
+            case 0x13: cart->mbc = MBC_3; cart->battery = true; break;
+            case 0x19: cart->mbc = MBC_5; break;
+            case 0x1a: cart->mbc = MBC_5; break;
+            case 0x1b: cart->mbc = MBC_5; cart->battery = true; break;
+            case 0x1c: cart->mbc = MBC_5; break;
+            case 0x1d: cart->mbc = MBC_5; break;
+            case 0x1e: cart->mbc = MBC_5; cart->battery = true; break;
+
+            default: {
+                _logc(slot, warning, "Unsupported cartridge type %02x, assuming no MBC", cart->type);
+
+                cart->mbc = MBC_NONE;
+            } break;
+        }
+
+        switch (cart->rom[0x149]) {
+            case 0x02: cart->ram_size = 0x2000; break;
+            case 0x03: cart->ram_size = 0x8000; break;
+            case 0x04: cart->ram_size = 0x20000; break;
+            case 0x05: cart->ram_size = 0x10000; break;
+            default:   cart->ram_size = 0; break;
+        }
+
+        if (!cartridge_init_ram(cart, path, ram_buffer)) {
+            mapped_file_close(&cart->rom_file);
+
+            cart->rom = nullptr;
+
+            return false;
+        }
+
+        // Without an MBC there's nothing to enable RAM with
+        cart->ram_enable = cart->mbc == MBC_NONE;
+        cart->rom_bank = 1;
+
+        cartridge_update_banks(cart);
+
+        _logc(slot, info, "Loaded \"%s\": type %02x, %u ROM banks, %u bytes of RAM",
+            path,
+            cart->type,
+            cart->rom_banks,
+            cart->ram_size
+        );
+
+        return true;
+    }
+
+    // Batched writeback of battery-backed RAM, doesn't block
+    void cartridge_flush(cartridge_t* cart) {
+        mapped_file_sync(&cart->ram_file, false);
+    }
+
+    void cartridge_unload(cartridge_t* cart) {
+        if (!cart->rom) return;
+
+        // Waits for the writeback to complete
+        mapped_file_close(&cart->ram_file);
+
+        // Borrowed ROMs (see clone) have no mapping of their own
+        mapped_file_close(&cart->rom_file);
+
+        std::memset(cart, 0, sizeof(cartridge_t));
+    }
+
+    inline uint8_t cartridge_read_rom(cartridge_t* cart, uint16_t addr) {
+        return cart->bank[(addr >> 14) & 0x1][addr & 0x3fff];
+    }
+
+    // Writes to 0000-7fff go to the MBC registers
+    void cartridge_write_rom(cartridge_t* cart, uint16_t addr, uint8_t data) {
+        switch (cart->mbc) {
+            case MBC_NONE: return;
+
+            case MBC_1: {
+                switch (addr >> 13) {
+                    case 0: cart->ram_enable = (data & 0xf) == 0xa; break;
+                    case 1: cart->rom_bank = (data & 0x1f) ? (data & 0x1f) : 1; break;
+                    case 2: cart->ram_bank = data & 0x3; break;
+                    case 3: cart->mode = data & 0x1; break;
+                }
+            } break;
+
+            case MBC_3: {
+                switch (addr >> 13) {
+                    case 0: cart->ram_enable = (data & 0xf) == 0xa; break;
+                    case 1: cart->rom_bank = (data & 0x7f) ? (data & 0x7f) : 1; break;
+                    case 2: cart->ram_bank = data; break;
+                    case 3: {
+                        // Writing 00 then 01 latches the clock
+                        if (!cart->rtc_latch_prev && (data == 1))
+                            std::memcpy(cart->rtc_latched, cart->rtc_regs, sizeof(cart->rtc_regs));
+
+                        cart->rtc_latch_prev = data;
+                    } break;
+                }
+            } break;
+
+            case MBC_5: {
+                switch (addr >> 12) {
+                    case 0: case 1: cart->ram_enable = (data & 0xf) == 0xa; break;
+                    case 2: cart->rom_bank = (cart->rom_bank & 0x100) | data; break;
+                    case 3: cart->rom_bank = (cart->rom_bank & 0xff) | ((data & 0x1) << 8); break;
+                    case 4: case 5: cart->ram_bank = data & 0xf; break;
+                }
+            } break;
+        }
+
+        cartridge_update_banks(cart);
+    }
+
+    uint8_t cartridge_read_ram(cartridge_t* cart, uint16_t addr) {
+        if (cart->ram_window) return cart->ram_window[addr & 0x1fff];
+
+        // MBC3 RTC registers 08-0c
+        if (cart->rtc && cart->ram_enable && RANGE(cart->ram_bank, 0x08, 0x0c))
+            return cart->rtc_latched[cart->ram_bank - 0x08];
+
+        return 0xff;
+    }
+
+    void cartridge_write_ram(cartridge_t* cart, uint16_t addr, uint8_t data) {
+        if (cart->ram_window) {
+            cart->ram_window[addr & 0x1fff] = data;
+
+            return;
+        }
+
+        if (cart->rtc && cart->ram_enable && RANGE(cart->ram_bank, 0x08, 0x0c))
+            cart->rtc_regs[cart->ram_bank - 0x08] = data;
+    }
+}
\ No newline at end of file
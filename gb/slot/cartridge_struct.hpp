@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../macros.hpp"
+#include "../structs.hpp"
+#include "../mapped_file.hpp"
+
+// Largest external RAM a supported MBC can address (MBC5, 16 banks)
+#define CART_RAM_MAX 0x20000
+
+namespace gb {
+    enum mbc_type_t {
+        MBC_NONE,
+        MBC_1,
+        MBC_3,
+        MBC_5
+    };
+
+    struct cartridge_t {
+        // ROM image, mapped read-only
+        mapped_file_t rom_file;
+
+        const uint8_t* rom;
+        uint32_t rom_banks;     // Number of 16KB banks
+
+        uint8_t type;           // Header byte 0x147
+        mbc_type_t mbc;
+
+        uint32_t ram_size;
+        bool battery;
+        bool rtc;
+
+        // External RAM, either the buffer the slot provides or, for
+        // battery backed cartridges, a read-write mapping of the .sav
+        // file (flushed on frame boundaries and on unload)
+        mapped_file_t ram_file;
+
+        uint8_t* ram;
+
+        // MBC registers
+        bool ram_enable;
+        uint16_t rom_bank;      // MBC1: lower 5 bits only
+        uint8_t ram_bank;       // MBC1: upper 2 bits, MBC3: RTC select too
+        uint8_t mode;           // MBC1 banking mode
+
+        // MBC3 RTC registers (S, M, H, DL, DH), these
+        // only hold what was written, the clock doesn't tick yet
+        uint8_t rtc_regs[5];
+        uint8_t rtc_latched[5];
+        uint8_t rtc_latch_prev;
+
+        // Host pointers to the banks currently visible at
+        // 0000-3fff and 4000-7fff, so reads are a single load
+        const uint8_t* bank[2];
+
+        // Host pointer to the RAM bank visible at a000-bfff,
+        // null if RAM is disabled or an RTC register is selected
+        uint8_t* ram_window;
+    };
+}
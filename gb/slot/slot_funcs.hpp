@@ -1,54 +1,123 @@
 #pragma once
 
+#include <cstring>
+
 #include "../macros.hpp"
 #include "../structs.hpp"
 
+#include "../memory_map.hpp"
+
 #include "slot_struct.hpp"
+#include "cartridge_funcs.hpp"
 
 #include "../lr35902/lr35902_struct.hpp"
+#include "../lr35902/bus_funcs.hpp"
 
 namespace gb {
-    void slot_init(cartridge_slot_t* slot, lr35902_t* lr35902) {
-        slot->pins = lr35902->ext_bus;
-    }
-
-    // uint8_t rom[0xff] = {
-    //     0xd7, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    //     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    //     0x06, 0xab
-    // };
-
-    uint8_t rom[] = {
-        0x31, 0xfe, 0xff, 0xaf, 0x21, 0xff, 0x9f, 0x32, 0xcb, 0x7c, 0x20, 0xfb,
-        0x21, 0x26, 0xff, 0x0e, 0x11, 0x3e, 0x80, 0x32, 0xe2, 0x0c, 0x3e, 0xf3,
-        0xe2, 0x32, 0x3e, 0x77, 0x77, 0x3e, 0xfc, 0xe0, 0x47, 0x11, 0x04, 0x01,
-        0x21, 0x10, 0x80, 0x1a, 0xcd, 0x95, 0x00, 0xcd, 0x96, 0x00, 0x13, 0x7b,
-        0xfe, 0x34, 0x20, 0xf3, 0x11, 0xd8, 0x00, 0x06, 0x08, 0x1a, 0x13, 0x22,
-        0x23, 0x05, 0x20, 0xf9, 0x3e, 0x19, 0xea, 0x10, 0x99, 0x21, 0x2f, 0x99,
-        0x0e, 0x0c, 0x3d, 0x28, 0x08, 0x32, 0x0d, 0x20, 0xf9, 0x2e, 0x0f, 0x18,
-        0xf3, 0x67, 0x3e, 0x64, 0x57, 0xe0, 0x42, 0x3e, 0x91, 0xe0, 0x40, 0x04,
-        0x1e, 0x02, 0x0e, 0x0c, 0xf0, 0x44, 0xfe, 0x90, 0x20, 0xfa, 0x0d, 0x20,
-        0xf7, 0x1d, 0x20, 0xf2, 0x0e, 0x13, 0x24, 0x7c, 0x1e, 0x83, 0xfe, 0x62,
-        0x28, 0x06, 0x1e, 0xc1, 0xfe, 0x64, 0x20, 0x06, 0x7b, 0xe2, 0x0c, 0x3e,
-        0x87, 0xe2, 0xf0, 0x42, 0x90, 0xe0, 0x42, 0x15, 0x20, 0xd2, 0x05, 0x20,
-        0x4f, 0x16, 0x20, 0x18, 0xcb, 0x4f, 0x06, 0x04, 0xc5, 0xcb, 0x11, 0x17,
-        0xc1, 0xcb, 0x11, 0x17, 0x05, 0x20, 0xf5, 0x22, 0x23, 0x22, 0x23, 0xc9,
-        0xce, 0xed, 0x66, 0x66, 0xcc, 0x0d, 0x00, 0x0b, 0x03, 0x73, 0x00, 0x83,
-        0x00, 0x0c, 0x00, 0x0d, 0x00, 0x08, 0x11, 0x1f, 0x88, 0x89, 0x00, 0x0e,
-        0xdc, 0xcc, 0x6e, 0xe6, 0xdd, 0xdd, 0xd9, 0x99, 0xbb, 0xbb, 0x67, 0x63,
-        0x6e, 0x0e, 0xec, 0xcc, 0xdd, 0xdc, 0x99, 0x9f, 0xbb, 0xb9, 0x33, 0x3e,
-        0x3c, 0x42, 0xb9, 0xa5, 0xb9, 0xa5, 0x42, 0x3c, 0x21, 0x04, 0x01, 0x11,
-        0xa8, 0x00, 0x1a, 0x13, 0xbe, 0x20, 0xfe, 0x23, 0x7d, 0xfe, 0x34, 0x20,
-        0xf5, 0x06, 0x19, 0x78, 0x86, 0x23, 0x05, 0x20, 0xfb, 0x86, 0x20, 0xfe,
-        0x3e, 0x01, 0xe0, 0x50
-    };
+    void slot_notify(void* ctx, uint32_t prev, uint32_t curr, uint32_t changed);
+
+    void slot_init(cartridge_slot_t* slot, lr35902_t* lr35902, uint8_t* ram_buffer) {
+        std::memset(slot, 0, sizeof(cartridge_slot_t));
+
+        slot->pins = &lr35902->ext_bus;
+        slot->ram_buffer = ram_buffer;
+        slot->prev = BUS_WR;
+
+        // The cartridge decodes the whole address bus, /CS,
+        // /RD (to output data) and /WR (MBC register writes)
+        bus_subscribe(&lr35902->ext_pub, BUS_A | BUS_CS | BUS_RD | BUS_WR, slot_notify, slot);
+    }
+
+    // Transaction-level mapping, used by the fast core.
+    // ROM banks are mapped directly, MBC writes go through slot_write
+    void slot_map(cartridge_slot_t* slot, memory_map_t* map) {
+        slot->map = map;
+
+        if (slot->cart.rom) {
+            mem_map(map, 0x0000, 0x3fff, slot->cart.bank[0], nullptr);
+            mem_map(map, 0x4000, 0x7fff, slot->cart.bank[1], nullptr);
+        } else {
+            mem_unmap(map, 0x0000, 0x7fff);
+        }
+
+        // Writes to external RAM land straight in the
+        // RAM buffer (or the .sav mapping)
+        if (slot->cart.ram_window) {
+            mem_map(map, 0xa000, 0xbfff, slot->cart.ram_window, slot->cart.ram_window);
+        } else {
+            mem_unmap(map, 0xa000, 0xbfff);
+        }
+    }
+
+    void slot_eject(cartridge_slot_t* slot) {
+        cartridge_unload(&slot->cart);
+
+        if (slot->map) slot_map(slot, slot->map);
+    }
+
+    // Whatever was in the slot is ejected first, so its
+    // ROM mapping and .sav get released (and flushed)
+    bool slot_insert(cartridge_slot_t* slot, const char* path) {
+        slot_eject(slot);
+
+        if (!cartridge_load(&slot->cart, path, slot->ram_buffer))
+            return false;
+
+        if (slot->map) slot_map(slot, slot->map);
+
+        return true;
+    }
+
+    uint8_t slot_read(cartridge_slot_t* slot, uint16_t addr) {
+        if (!slot->cart.rom) return 0xff;
+
+        if (!(addr & 0x8000))
+            return cartridge_read_rom(&slot->cart, addr);
+
+        if (RANGE(addr, 0xa000, 0xbfff))
+            return cartridge_read_ram(&slot->cart, addr);
+
+        return 0xff;
+    }
+
+    void slot_write(cartridge_slot_t* slot, uint16_t addr, uint8_t data) {
+        if (!slot->cart.rom) return;
+
+        if (!(addr & 0x8000)) {
+            cartridge_write_rom(&slot->cart, addr, data);
+
+            if (slot->map) slot_map(slot, slot->map);
+        } else if (RANGE(addr, 0xa000, 0xbfff)) {
+            cartridge_write_ram(&slot->cart, addr, data);
+        }
+    }
+
+    void slot_flush(cartridge_slot_t* slot) {
+        if (slot->cart.rom) cartridge_flush(&slot->cart);
+    }
 
     void slot_clock(cartridge_slot_t* slot) {
-        // Simulate ROM
-        bool access = slot->pins->cs && !(slot->pins->a & 0x8000);
+        uint32_t pins = slot->pins->pins;
+        uint16_t addr = pins & BUS_A;
 
-        if (access && RANGE(slot->pins->a, 0x0000, 0xff)) {
-            slot->pins->d = rom[slot->pins->a];
+        // ROM is selected when /CS is high and A15 is low,
+        // RAM when /CS is low and A14 is low (a000-bfff)
+        bool access = (pins & BUS_CS) ? !(pins & BUS_A15)
+                                      : !(pins & BUS_A14);
+
+        if (access) {
+            if (slot->prev & ~pins & BUS_WR) {
+                // MBC registers and RAM latch D0-D7 on /WR falling edge
+                slot_write(slot, addr, bus_d(slot->pins));
+            } else if (!(pins & BUS_RD)) {
+                bus_set_d(slot->pins, slot_read(slot, addr));
+            }
         }
+
+        slot->prev = pins;
+    }
+
+    void slot_notify(void* ctx, uint32_t prev, uint32_t curr, uint32_t changed) {
+        slot_clock((cartridge_slot_t*)ctx);
     }
 }
\ No newline at end of file
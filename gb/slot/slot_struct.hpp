@@ -5,8 +5,22 @@
 
 #include "../lr35902/lr35902_struct.hpp"
 
+#include "cartridge_struct.hpp"
+
 namespace gb {
     struct cartridge_slot_t {
         bus_t* pins; // External bus
+
+        uint32_t prev;  // Pins on the last update, for edge detection
+
+        // Inserted cartridge, cart.rom is null if empty
+        cartridge_t cart;
+
+        // Transaction-level map to keep in sync on bank switches
+        memory_map_t* map;
+
+        // CART_RAM_MAX bytes owned by whoever owns the slot,
+        // backs external RAM that isn't battery backed
+        uint8_t* ram_buffer;
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+
+#include "macros.hpp"
+#include "structs.hpp"
+#include "log.hpp"
+
+#include "gameboy.hpp"
+
+// Save states are a flat image of the component structs, exactly as
+// they sit in memory, followed by the memories they point to. Saving
+// and loading are a handful of memcpys, after loading, every pointer
+// is re-hydrated from the live instance (they are never trusted from
+// the image).
+//
+// Images are only portable between builds with the same struct
+// layout, which the header fingerprints.
+
+#define STATE_MAGIC   "GBST"
+#define STATE_VERSION 9
+
+namespace gb {
+    struct state_header_t {
+        char magic[4];
+        uint16_t version;
+        uint16_t flags;         // Reserved, always 0
+        uint32_t size;          // Whole image, including cartridge RAM
+        uint32_t layout;        // Fingerprint of the struct layouts below
+        uint32_t cart_ram_size;
+    };
+
+    struct state_image_t {
+        state_header_t header;
+
+        lr35902_t        soc;
+        cpu_t            cpu;
+        bootrom_t        boot;
+        lh5264_t         wram;  // WRAM contents included
+        cartridge_slot_t slot;
+        scheduler_t      sched;
+
+        // Followed by cart_ram_size bytes of cartridge RAM
+    };
+
+    constexpr uint32_t state_layout() {
+        uint32_t h = 2166136261u;
+
+        const size_t sizes[] = {
+            sizeof(lr35902_t),
+            sizeof(cpu_t),
+            sizeof(bootrom_t),
+            sizeof(lh5264_t),
+            sizeof(cartridge_slot_t),
+            sizeof(scheduler_t),
+            sizeof(state_image_t)
+        };
+
+        for (size_t s : sizes) {
+            h = (h ^ (uint32_t)s) * 16777619u;
+        }
+
+        return h;
+    }
+
+    size_t state_size(gameboy_t* gb) {
+        return sizeof(state_image_t) + gb->slot.cart.ram_size;
+    }
+
+    // Returns the number of bytes written, 0 if `buf` is too small
+    size_t save_state(gameboy_t* gb, uint8_t* buf, size_t size) {
+        size_t total = state_size(gb);
+
+        if (size < total) return 0;
+
+        // Images always hold F as is, whatever the flag mode
+        cpu_flags_sync(&gb->cpu);
+
+        state_header_t header;
+
+        std::memcpy(header.magic, STATE_MAGIC, 4);
+
+        header.version = STATE_VERSION;
+        header.flags = 0;
+        header.size = total;
+        header.layout = state_layout();
+        header.cart_ram_size = gb->slot.cart.ram_size;
+
+        std::memcpy(buf + offsetof(state_image_t, header), &header, sizeof(state_header_t));
+        std::memcpy(buf + offsetof(state_image_t, soc), &gb->soc, sizeof(lr35902_t));
+        std::memcpy(buf + offsetof(state_image_t, cpu), &gb->cpu, sizeof(cpu_t));
+        std::memcpy(buf + offsetof(state_image_t, boot), &gb->boot, sizeof(bootrom_t));
+        std::memcpy(buf + offsetof(state_image_t, wram), &gb->wram, sizeof(lh5264_t));
+        std::memcpy(buf + offsetof(state_image_t, slot), &gb->slot, sizeof(cartridge_slot_t));
+        std::memcpy(buf + offsetof(state_image_t, sched), &gb->sched, sizeof(scheduler_t));
+
+        if (gb->slot.cart.ram_size)
+            std::memcpy(buf + sizeof(state_image_t), gb->slot.cart.ram, gb->slot.cart.ram_size);
+
+        return total;
+    }
+
+    bool state_check(gameboy_t* gb, const uint8_t* buf, size_t size) {
+        state_header_t header;
+
+        if (size < sizeof(state_image_t)) {
+            _logc(state, error, "Save state is truncated");
+
+            return false;
+        }
+
+        std::memcpy(&header, buf, sizeof(state_header_t));
+
+        if (std::memcmp(header.magic, STATE_MAGIC, 4)) {
+            _logc(state, error, "Not a save state");
+
+            return false;
+        }
+
+        if ((header.version != STATE_VERSION) || (header.layout != state_layout())) {
+            _logc(state, error, "Save state version %u (layout %08x) doesn't match this build", header.version, header.layout);
+
+            return false;
+        }
+
+        if ((header.size > size) || (header.cart_ram_size != gb->slot.cart.ram_size)) {
+            _logc(state, error, "Save state doesn't match the inserted cartridge");
+
+            return false;
+        }
+
+        return true;
+    }
+
+    bool load_state(gameboy_t* gb, const uint8_t* buf, size_t size) {
+        if (!state_check(gb, buf, size))
+            return false;
+
+        // Keep everything that isn't state: pointers,
+        // event handlers, and the cartridge's resources
+        lr35902_t soc = gb->soc;
+        bootrom_t boot = gb->boot;
+        bus_t* wram_pins = gb->wram.pins;
+        cartridge_slot_t slot = gb->slot;
+        scheduler_t sched = gb->sched;
+
+        std::memcpy(&gb->soc, buf + offsetof(state_image_t, soc), sizeof(lr35902_t));
+        std::memcpy(&gb->cpu, buf + offsetof(state_image_t, cpu), sizeof(cpu_t));
+        std::memcpy(&gb->boot, buf + offsetof(state_image_t, boot), sizeof(bootrom_t));
+        std::memcpy(&gb->wram, buf + offsetof(state_image_t, wram), sizeof(lh5264_t));
+        std::memcpy(&gb->slot, buf + offsetof(state_image_t, slot), sizeof(cartridge_slot_t));
+        std::memcpy(&gb->sched, buf + offsetof(state_image_t, sched), sizeof(scheduler_t));
+
+        if (slot.cart.ram_size)
+            std::memcpy(slot.cart.ram, buf + sizeof(state_image_t), slot.cart.ram_size);
+
+        // Re-hydrate pointers
+        std::memcpy(gb->soc.ext_pub.listeners, soc.ext_pub.listeners, sizeof(soc.ext_pub.listeners));
+
+        gb->soc.ext_pub.count = soc.ext_pub.count;
+        gb->soc.cpu = soc.cpu;
+        gb->soc.ppu = soc.ppu;
+        gb->soc.apu = soc.apu;
+        gb->soc.sc = soc.sc;
+        gb->soc.boot = soc.boot;
+
+        // The switch engine doesn't keep this up to date
+        gb->cpu.resume = cpu_resume_point(&gb->cpu);
+
+        gb->cpu.main_bus_set = &gb->soc.main_bus_set;
+        gb->cpu.vram_bus_set = &gb->soc.vram_bus_set;
+        gb->cpu.boot = &gb->soc.boot;
+
+        gb->boot.rom = boot.rom;
+        gb->boot.map = boot.map;
+
+        // Only boot_off comes from the image
+        if (gb->boot.map) bootrom_map(&gb->boot, gb->boot.map);
+
+        gb->wram.pins = wram_pins;
+
+        // Only the MBC registers come from the image
+        cartridge_t* cart = &gb->slot.cart;
+
+        gb->slot.pins = slot.pins;
+        gb->slot.map = slot.map;
+        gb->slot.ram_buffer = slot.ram_buffer;
+
+        cart->rom_file = slot.cart.rom_file;
+        cart->rom = slot.cart.rom;
+        cart->rom_banks = slot.cart.rom_banks;
+        cart->type = slot.cart.type;
+        cart->mbc = slot.cart.mbc;
+        cart->ram_size = slot.cart.ram_size;
+        cart->battery = slot.cart.battery;
+        cart->rtc = slot.cart.rtc;
+        cart->ram_file = slot.cart.ram_file;
+        cart->ram = slot.cart.ram;
+
+        if (cart->rom) cartridge_update_banks(cart);
+
+        if (gb->slot.map) slot_map(&gb->slot, gb->slot.map);
+
+        std::memcpy(gb->sched.handler, sched.handler, sizeof(sched.handler));
+        std::memcpy(gb->sched.ctx, sched.ctx, sizeof(sched.ctx));
+
+        return true;
+    }
+
+    bool save_state_file(gameboy_t* gb, const char* path) {
+        size_t size = state_size(gb);
+        uint8_t* buf = new uint8_t[size];
+
+        save_state(gb, buf, size);
+
+        FILE* file = std::fopen(path, "wb");
+
+        bool ok = file && (std::fwrite(buf, 1, size, file) == size);
+
+        if (file) std::fclose(file);
+
+        delete[] buf;
+
+        if (!ok) _logc(state, error, "Couldn't write save state \"%s\"", path);
+
+        return ok;
+    }
+
+    bool load_state_file(gameboy_t* gb, const char* path) {
+        mapped_file_t file;
+
+        if (!mapped_file_open(&file, path))
+            return false;
+
+        bool ok = load_state(gb, file.data, file.size);
+
+        mapped_file_close(&file);
+
+        return ok;
+    }
+}
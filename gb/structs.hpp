@@ -8,4 +8,5 @@ namespace gb {
     struct lr35902_t;
     struct bootrom_t;
     struct cartridge_slot_t;
+    struct memory_map_t;
 }
\ No newline at end of file
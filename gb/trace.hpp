@@ -0,0 +1,376 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "macros.hpp"
+#include "structs.hpp"
+#include "log.hpp"
+#include "mapped_file.hpp"
+
+#include "gameboy.hpp"
+
+// Binary CPU traces. The emulation thread appends fixed-size records
+// to a single-producer/single-consumer ring, a writer thread drains
+// it to disk in large chunks. Nothing on the recording side formats,
+// allocates or locks; when the writer falls behind the emulation
+// thread waits for room instead of dropping records.
+//
+// Records are full state, any of them is a valid place to start
+// decoding from. Every TRACE_INDEX_INTERVAL records, the writer notes
+// the timestamp and file offset, the index goes into a footer when
+// the trace is closed:
+//
+//   header | records... | index entries... | footer
+//
+// Readers map the file and find any cycle in O(log n), see trace_seek.
+// trace_decode turns a trace back into the text log_cpu_state_*
+// used to print.
+
+#define TRACE_MAGIC       "GBTR"
+#define TRACE_INDEX_MAGIC "GBTI"
+#define TRACE_VERSION     2
+
+// Default ring size, in records (power of two)
+#define TRACE_RING_RECORDS (1 << 20)
+
+// Records between index entries
+#define TRACE_INDEX_INTERVAL 4096
+
+namespace gb {
+    struct trace_header_t {
+        char magic[4];
+        uint16_t version;
+        uint16_t record_size;
+    };
+
+    // CK and T cycle count are derived from `now`
+    // (see cpu_update_clocks)
+    struct trace_record_t {
+        uint64_t now;
+        uint32_t pins;      // External bus
+        uint16_t pc;
+        uint16_t sp;
+        uint8_t r[8];       // B, C, D, E, H, L, F, A
+    };
+
+    static_assert(sizeof(trace_record_t) == 24, "Trace records are part of the file format");
+
+    struct trace_index_t {
+        uint64_t now;       // Timestamp of the record at `offset`
+        uint64_t offset;
+    };
+
+    struct trace_footer_t {
+        char magic[4];
+        uint32_t reserved;
+        uint64_t records;
+        uint64_t index_offset;
+        uint64_t index_count;
+    };
+
+    struct trace_t {
+        trace_record_t* ring;
+        uint64_t mask;
+
+        FILE* file;
+        std::thread writer;
+
+        // Only touched by the writer until trace_close
+        std::vector<trace_index_t> index;
+
+        // Producer and consumer side on separate cache lines
+        alignas(64) std::atomic<uint64_t> head;     // Next record to write
+        uint64_t tail_cache;                        // Producer's view of tail
+
+        alignas(64) std::atomic<uint64_t> tail;     // Next record to drain
+        std::atomic<bool> done;
+    };
+
+    void trace_drain(trace_t* tr) {
+        uint64_t tail = tr->tail.load(std::memory_order_relaxed);
+
+        while (true) {
+            uint64_t head = tr->head.load(std::memory_order_acquire);
+
+            if (head == tail) {
+                // Only stop once everything pushed before
+                // trace_close is on disk
+                if (tr->done.load(std::memory_order_acquire) && (tr->head.load(std::memory_order_acquire) == tail))
+                    return;
+
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+                continue;
+            }
+
+            // Up to the end of the ring, the rest goes next round
+            uint64_t start = tail & tr->mask;
+            uint64_t count = head - tail;
+
+            if (start + count > tr->mask + 1)
+                count = tr->mask + 1 - start;
+
+            // Index whatever records in this chunk land on the interval
+            uint64_t next = (tail + TRACE_INDEX_INTERVAL - 1) / TRACE_INDEX_INTERVAL * TRACE_INDEX_INTERVAL;
+
+            for (uint64_t i = next; i < tail + count; i += TRACE_INDEX_INTERVAL)
+                tr->index.push_back({ tr->ring[i & tr->mask].now, sizeof(trace_header_t) + i * sizeof(trace_record_t) });
+
+            std::fwrite(&tr->ring[start], sizeof(trace_record_t), count, tr->file);
+
+            tail += count;
+
+            tr->tail.store(tail, std::memory_order_release);
+        }
+    }
+
+    // `records` is rounded up to a power of two
+    bool trace_open(trace_t* tr, const char* path, uint64_t records = TRACE_RING_RECORDS) {
+        uint64_t size = 1;
+
+        while (size < records) size <<= 1;
+
+        tr->file = std::fopen(path, "wb");
+
+        if (!tr->file) {
+            _logc(trace, error, "Couldn't open trace \"%s\"", path);
+
+            return false;
+        }
+
+        trace_header_t header;
+
+        std::memcpy(header.magic, TRACE_MAGIC, 4);
+
+        header.version = TRACE_VERSION;
+        header.record_size = sizeof(trace_record_t);
+
+        std::fwrite(&header, sizeof(trace_header_t), 1, tr->file);
+
+        tr->ring = new trace_record_t[size];
+        tr->mask = size - 1;
+        tr->head.store(0, std::memory_order_relaxed);
+        tr->tail.store(0, std::memory_order_relaxed);
+        tr->tail_cache = 0;
+        tr->done.store(false, std::memory_order_relaxed);
+        tr->index.clear();
+        tr->writer = std::thread(trace_drain, tr);
+
+        return true;
+    }
+
+    inline void trace_push(trace_t* tr, const trace_record_t& rec) {
+        uint64_t head = tr->head.load(std::memory_order_relaxed);
+
+        // Ring full, wait for the writer
+        if (head - tr->tail_cache > tr->mask) {
+            while (head - (tr->tail_cache = tr->tail.load(std::memory_order_acquire)) > tr->mask)
+                std::this_thread::yield();
+        }
+
+        tr->ring[head & tr->mask] = rec;
+
+        tr->head.store(head + 1, std::memory_order_release);
+    }
+
+    // Snapshot the instance as it is right now
+    inline void trace_record(trace_t* tr, gameboy_t* gb) {
+        trace_record_t rec;
+
+        rec.now = gb->sched.now;
+        rec.pins = gb->soc.ext_bus.pins;
+        rec.pc = gb->cpu.pc;
+        rec.sp = gb->cpu.sp;
+
+        std::memcpy(rec.r, gb->cpu.r, sizeof(rec.r));
+
+        rec.r[6] = cpu_flags(&gb->cpu);
+
+        trace_push(tr, rec);
+    }
+
+    // Flushes whatever is left in the ring, writes the
+    // index and closes the file
+    void trace_close(trace_t* tr) {
+        if (!tr->file) return;
+
+        tr->done.store(true, std::memory_order_release);
+        tr->writer.join();
+
+        trace_footer_t footer;
+
+        std::memcpy(footer.magic, TRACE_INDEX_MAGIC, 4);
+
+        footer.reserved = 0;
+        footer.records = tr->head.load(std::memory_order_relaxed);
+        footer.index_offset = sizeof(trace_header_t) + footer.records * sizeof(trace_record_t);
+        footer.index_count = tr->index.size();
+
+        std::fwrite(tr->index.data(), sizeof(trace_index_t), tr->index.size(), tr->file);
+        std::fwrite(&footer, sizeof(trace_footer_t), 1, tr->file);
+        std::fclose(tr->file);
+
+        tr->index.clear();
+        tr->index.shrink_to_fit();
+
+        delete[] tr->ring;
+
+        tr->file = nullptr;
+        tr->ring = nullptr;
+    }
+
+    // Text output, one line per record (TD_HALF_CYCLE) or
+    // one per M cycle start (TD_M_CYCLE)
+    enum trace_decode_mode_t : uint8_t {
+        TD_M_CYCLE,
+        TD_HALF_CYCLE
+    };
+
+    void trace_format(const trace_record_t* rec, uint8_t mode, FILE* out) {
+        bus_t bus = { rec->pins };
+
+        uint8_t ck = rec->now & (M - 1);
+
+        if (mode == TD_M_CYCLE) {
+            if (ck) return;
+
+            std::fprintf(out, "PC=%04x, ", rec->pc);
+        } else {
+            if (!ck) std::fprintf(out, "M cycle start\n");
+
+            std::fprintf(out, "CKH=%u, PC=%04x, ", ck, rec->pc);
+        }
+
+        std::fprintf(out, "A0-A14=%04x, RD=%u, WR=%u, A15=%u, CS=%u, D0-D7=%02x, AF=%04x, BC=%04x, DE=%04x, HL=%04x, SP=%04x, CYC=%llu\n",
+            bus_a(&bus) & 0x7fff,
+            bus_rd(&bus),
+            bus_wr(&bus),
+            bus_cs(&bus),
+            (bus_a(&bus) >> 15) & 0x1,
+            bus_d(&bus),
+            (rec->r[7] << 8) | rec->r[6],
+            (rec->r[0] << 8) | rec->r[1],
+            (rec->r[2] << 8) | rec->r[3],
+            (rec->r[4] << 8) | rec->r[5],
+            rec->sp,
+            (unsigned long long)(rec->now / T)
+        );
+    }
+
+    struct trace_reader_t {
+        mapped_file_t file;
+
+        uint64_t records;
+
+        // Straight from the mapping
+        const trace_index_t* index;
+        uint64_t index_count;
+    };
+
+    bool trace_reader_open(trace_reader_t* r, const char* path) {
+        std::memset(r, 0, sizeof(trace_reader_t));
+
+        if (!mapped_file_open(&r->file, path))
+            return false;
+
+        trace_header_t header;
+        trace_footer_t footer;
+
+        size_t size = r->file.size;
+
+        bool ok = size >= sizeof(trace_header_t) + sizeof(trace_footer_t);
+
+        if (ok) {
+            std::memcpy(&header, r->file.data, sizeof(trace_header_t));
+            std::memcpy(&footer, r->file.data + size - sizeof(trace_footer_t), sizeof(trace_footer_t));
+
+            ok = !std::memcmp(header.magic, TRACE_MAGIC, 4) &&
+                 !std::memcmp(footer.magic, TRACE_INDEX_MAGIC, 4) &&
+                 (header.version == TRACE_VERSION) &&
+                 (header.record_size == sizeof(trace_record_t)) &&
+                 (footer.index_offset == sizeof(trace_header_t) + footer.records * sizeof(trace_record_t)) &&
+                 (footer.index_offset + footer.index_count * sizeof(trace_index_t) + sizeof(trace_footer_t) == size);
+        }
+
+        if (!ok) {
+            _logc(trace, error, "\"%s\" isn't a complete trace, or was written by another version", path);
+
+            mapped_file_close(&r->file);
+
+            return false;
+        }
+
+        r->records = footer.records;
+        r->index = (const trace_index_t*)(r->file.data + footer.index_offset);
+        r->index_count = footer.index_count;
+
+        return true;
+    }
+
+    void trace_reader_close(trace_reader_t* r) {
+        mapped_file_close(&r->file);
+    }
+
+    inline trace_record_t trace_reader_get(trace_reader_t* r, uint64_t i) {
+        trace_record_t rec;
+
+        std::memcpy(&rec, r->file.data + sizeof(trace_header_t) + i * sizeof(trace_record_t), sizeof(trace_record_t));
+
+        return rec;
+    }
+
+    // First record at or after `t_cycles` T cycles (records
+    // if there's none): binary search the index for the block,
+    // then the block for the record
+    uint64_t trace_seek(trace_reader_t* r, uint64_t t_cycles) {
+        uint64_t now = t_cycles * T;
+
+        const trace_index_t* end = r->index + r->index_count;
+        const trace_index_t* block = std::upper_bound(r->index, end, now,
+            [](uint64_t n, const trace_index_t& e) { return n < e.now; });
+
+        uint64_t lo = (block == r->index) ? 0 : ((block - 1)->offset - sizeof(trace_header_t)) / sizeof(trace_record_t);
+        uint64_t hi = (block == end) ? r->records : (block->offset - sizeof(trace_header_t)) / sizeof(trace_record_t);
+
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+
+            if (trace_reader_get(r, mid).now < now) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        return lo;
+    }
+
+    // Decode `count` records starting at T cycle `from`
+    bool trace_decode(const char* path, uint8_t mode, FILE* out, uint64_t from = 0, uint64_t count = UINT64_MAX) {
+        trace_reader_t r;
+
+        if (!trace_reader_open(&r, path))
+            return false;
+
+        uint64_t first = trace_seek(&r, from);
+        uint64_t last = (count < r.records - first) ? first + count : r.records;
+
+        for (uint64_t i = first; i < last; i++) {
+            trace_record_t rec = trace_reader_get(&r, i);
+
+            trace_format(&rec, mode, out);
+        }
+
+        trace_reader_close(&r);
+
+        return true;
+    }
+}
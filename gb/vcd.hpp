@@ -0,0 +1,257 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+
+#include "macros.hpp"
+#include "structs.hpp"
+#include "log.hpp"
+
+#include "gameboy.hpp"
+
+// Waveform export of the LR35902's pins as VCD, for GTKWave and
+// friends. Only transitions are written, through a fixed-size block
+// buffer, so memory stays constant however long the capture runs.
+//
+// For long captures, GTKWave's vcd2fst turns the output into a
+// (much smaller) FST file.
+//
+// Time is in picoseconds, one half cycle being 1/8388608 s
+
+#define VCD_BUFFER_SIZE (1 << 20)
+
+namespace gb {
+    enum vcd_signal_t : uint8_t {
+        // External bus
+        VS_A, VS_D, VS_RD, VS_WR, VS_CS,
+
+        // Clock phase, cpu_t::ck_half_cycle
+        VS_CK,
+
+        // lr35902_t::pins_t
+        VS_MA, VS_MD, VS_MWR, VS_MRD, VS_MCS,
+        VS_CK1, VS_CK2, VS_PHI,
+        VS_P1,
+        VS_SCK, VS_SIN, VS_SOUT,
+        VS_LD0, VS_LD1, VS_CPG, VS_CP, VS_ST, VS_CPL, VS_FR, VS_S,
+
+        // Analog pins, written as reals
+        VS_SO1, VS_SO2, VS_VIN, VS_RES,
+
+        VS_COUNT
+    };
+
+    #define VS_FIRST_REAL VS_SO1
+
+    struct vcd_var_t {
+        const char* name;
+        uint8_t width;
+    };
+
+    // Active-low pins are prefixed with n
+    constexpr vcd_var_t vcd_vars[VS_COUNT] = {
+        { "A", 16 }, { "D", 8 }, { "nRD", 1 }, { "nWR", 1 }, { "nCS", 1 },
+        { "CK", 3 },
+        { "MA", 13 }, { "MD", 8 }, { "nMWR", 1 }, { "nMRD", 1 }, { "nMCS", 1 },
+        { "CK1", 1 }, { "CK2", 1 }, { "PHI", 1 },
+        { "P1", 6 },
+        { "SCK", 1 }, { "SIN", 1 }, { "SOUT", 1 },
+        { "LD0", 1 }, { "LD1", 1 }, { "CPG", 1 }, { "CP", 1 }, { "ST", 1 }, { "CPL", 1 }, { "FR", 1 }, { "S", 1 },
+        { "SO1", 64 }, { "SO2", 64 }, { "VIN", 64 }, { "nRES", 64 }
+    };
+
+    struct vcd_t {
+        FILE* file;
+
+        char* buf;
+        size_t used;
+
+        // Last written values, reals are stored as their bits
+        uint32_t prev[VS_COUNT];
+        bool started;
+    };
+
+    // Identifier codes are single printable characters
+    inline char vcd_id(int signal) {
+        return '!' + signal;
+    }
+
+    inline void vcd_flush(vcd_t* vcd) {
+        std::fwrite(vcd->buf, 1, vcd->used, vcd->file);
+
+        vcd->used = 0;
+    }
+
+    // Longest single change: "b" + 64 bits + " " + id + "\n"
+    inline void vcd_reserve(vcd_t* vcd) {
+        if (vcd->used > VCD_BUFFER_SIZE - 128) vcd_flush(vcd);
+    }
+
+    inline void vcd_write_change(vcd_t* vcd, int signal, uint32_t value) {
+        vcd_reserve(vcd);
+
+        char* p = vcd->buf + vcd->used;
+
+        if (signal >= VS_FIRST_REAL) {
+            float f;
+
+            std::memcpy(&f, &value, sizeof(float));
+
+            p += std::snprintf(p, 64, "r%.9g %c\n", f, vcd_id(signal));
+        } else if (vcd_vars[signal].width == 1) {
+            *p++ = '0' + (value & 1);
+            *p++ = vcd_id(signal);
+            *p++ = '\n';
+        } else {
+            *p++ = 'b';
+
+            for (int i = vcd_vars[signal].width - 1; i >= 0; i--)
+                *p++ = '0' + ((value >> i) & 1);
+
+            *p++ = ' ';
+            *p++ = vcd_id(signal);
+            *p++ = '\n';
+        }
+
+        vcd->used = p - vcd->buf;
+    }
+
+    inline uint32_t vcd_real_bits(float f) {
+        uint32_t v;
+
+        std::memcpy(&v, &f, sizeof(float));
+
+        return v;
+    }
+
+    inline void vcd_gather(gameboy_t* gb, uint32_t* v) {
+        const bus_t* bus = &gb->soc.ext_bus;
+        const lr35902_t::pins_t& p = gb->soc.pins;
+
+        v[VS_A] = bus_a(bus);
+        v[VS_D] = bus_d(bus);
+        v[VS_RD] = bus_rd(bus);
+        v[VS_WR] = bus_wr(bus);
+        v[VS_CS] = bus_cs(bus);
+
+        v[VS_CK] = gb->sched.now & (M - 1);
+
+        v[VS_MA] = p.ma;
+        v[VS_MD] = p.md;
+        v[VS_MWR] = p.mwr;
+        v[VS_MRD] = p.mrd;
+        v[VS_MCS] = p.mcs;
+        v[VS_CK1] = p.ck[0];
+        v[VS_CK2] = p.ck[1];
+        v[VS_PHI] = p.phi;
+        v[VS_P1] = p.p1;
+        v[VS_SCK] = p.sck;
+        v[VS_SIN] = p.sin;
+        v[VS_SOUT] = p.sout;
+        v[VS_LD0] = p.ld[0];
+        v[VS_LD1] = p.ld[1];
+        v[VS_CPG] = p.cpg;
+        v[VS_CP] = p.cp;
+        v[VS_ST] = p.st;
+        v[VS_CPL] = p.cpl;
+        v[VS_FR] = p.fr;
+        v[VS_S] = p.s;
+
+        v[VS_SO1] = vcd_real_bits(p.so[0]);
+        v[VS_SO2] = vcd_real_bits(p.so[1]);
+        v[VS_VIN] = vcd_real_bits(p.vin);
+        v[VS_RES] = vcd_real_bits(p.res);
+    }
+
+    bool vcd_open(vcd_t* vcd, const char* path) {
+        std::memset(vcd, 0, sizeof(vcd_t));
+
+        vcd->file = std::fopen(path, "wb");
+
+        if (!vcd->file) {
+            _logc(trace, error, "Couldn't open \"%s\"", path);
+
+            return false;
+        }
+
+        vcd->buf = new char[VCD_BUFFER_SIZE];
+
+        std::fprintf(vcd->file,
+            "$version edge $end\n"
+            "$timescale 1ps $end\n"
+            "$scope module lr35902 $end\n"
+        );
+
+        for (int i = 0; i < VS_COUNT; i++) {
+            std::fprintf(vcd->file, "$var %s %u %c %s $end\n",
+                (i >= VS_FIRST_REAL) ? "real" : "wire",
+                vcd_vars[i].width,
+                vcd_id(i),
+                vcd_vars[i].name
+            );
+        }
+
+        std::fprintf(vcd->file, "$upscope $end\n$enddefinitions $end\n");
+
+        return true;
+    }
+
+    // Call after every clock(), half cycles nothing
+    // changed on cost a compare per signal
+    void vcd_sample(vcd_t* vcd, gameboy_t* gb) {
+        uint32_t v[VS_COUNT];
+
+        vcd_gather(gb, v);
+
+        bool stamped = false;
+
+        for (int i = 0; i < VS_COUNT; i++) {
+            if (vcd->started && (v[i] == vcd->prev[i])) continue;
+
+            if (!stamped) {
+                vcd_reserve(vcd);
+
+                // 1e12 / 8388608 = 244140625 / 2048
+                uint64_t ps = (gb->sched.now * 244140625ull) / 2048;
+
+                vcd->used += std::snprintf(vcd->buf + vcd->used, 64, "#%llu\n", (unsigned long long)ps);
+
+                if (!vcd->started) {
+                    std::memcpy(vcd->buf + vcd->used, "$dumpvars\n", 10);
+
+                    vcd->used += 10;
+                }
+
+                stamped = true;
+            }
+
+            vcd_write_change(vcd, i, v[i]);
+
+            vcd->prev[i] = v[i];
+        }
+
+        if (!vcd->started) {
+            vcd_reserve(vcd);
+
+            std::memcpy(vcd->buf + vcd->used, "$end\n", 5);
+
+            vcd->used += 5;
+            vcd->started = true;
+        }
+    }
+
+    void vcd_close(vcd_t* vcd) {
+        if (!vcd->file) return;
+
+        vcd_flush(vcd);
+
+        std::fclose(vcd->file);
+
+        delete[] vcd->buf;
+
+        vcd->file = nullptr;
+        vcd->buf = nullptr;
+    }
+}
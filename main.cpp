@@ -1,6 +1,17 @@
 #include "gb/gameboy.hpp"
+#include "gb/batch/batch_funcs.hpp"
+#include "gb/trace.hpp"
+#include "gb/vcd.hpp"
+#include "gb/doctor.hpp"
+#include "gb/multi/multi_check.hpp"
 #include "gb/log.hpp"
 
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <chrono>
+
 void log_cpu_state_hck(gb::gameboy_t* gb) {
     if (!gb->cpu.ck_half_cycle) {
         _log(debug, "M cycle start");
@@ -9,13 +20,13 @@ void log_cpu_state_hck(gb::gameboy_t* gb) {
     _log(debug, "CKH=%u, PC=%04x, A0-A14=%04x, RD=%u, WR=%u, A15=%u, CS=%u, D0-D7=%02x, AF=%04x, BC=%04x, DE=%04x, HL=%04x, SP=%04x, CYC=%u",
         gb->cpu.ck_half_cycle,
         gb->cpu.pc,
-        gb->soc.ext_bus->a & 0x7fff,
-        gb->soc.ext_bus->rd,
-        gb->soc.ext_bus->wr,
-        gb->soc.ext_bus->cs,
-        (gb->soc.ext_bus->a >> 15) & 0x1,
-        gb->soc.ext_bus->d,
-        (gb->cpu.r[7] << 8) | gb->cpu.r[6],
+        gb::bus_a(&gb->soc.ext_bus) & 0x7fff,
+        gb::bus_rd(&gb->soc.ext_bus),
+        gb::bus_wr(&gb->soc.ext_bus),
+        gb::bus_cs(&gb->soc.ext_bus),
+        (gb::bus_a(&gb->soc.ext_bus) >> 15) & 0x1,
+        gb::bus_d(&gb->soc.ext_bus),
+        (gb->cpu.r[7] << 8) | gb::cpu_flags(&gb->cpu),
         (gb->cpu.r[0] << 8) | gb->cpu.r[1],
         (gb->cpu.r[2] << 8) | gb->cpu.r[3],
         (gb->cpu.r[4] << 8) | gb->cpu.r[5],
@@ -28,13 +39,13 @@ void log_cpu_state_m(gb::gameboy_t* gb) {
     if (!gb->cpu.ck_half_cycle) {
         _log(debug, "PC=%04x, A0-A14=%04x, RD=%u, WR=%u, A15=%u, CS=%u, D0-D7=%02x, AF=%04x, BC=%04x, DE=%04x, HL=%04x, SP=%04x, CYC=%u",
             gb->cpu.pc,
-            gb->soc.ext_bus->a & 0x7fff,
-            gb->soc.ext_bus->rd,
-            gb->soc.ext_bus->wr,
-            gb->soc.ext_bus->cs,
-            (gb->soc.ext_bus->a >> 15) & 0x1,
-            gb->soc.ext_bus->d,
-            (gb->cpu.r[7] << 8) | gb->cpu.r[6],
+            gb::bus_a(&gb->soc.ext_bus) & 0x7fff,
+            gb::bus_rd(&gb->soc.ext_bus),
+            gb::bus_wr(&gb->soc.ext_bus),
+            gb::bus_cs(&gb->soc.ext_bus),
+            (gb::bus_a(&gb->soc.ext_bus) >> 15) & 0x1,
+            gb::bus_d(&gb->soc.ext_bus),
+            (gb->cpu.r[7] << 8) | gb::cpu_flags(&gb->cpu),
             (gb->cpu.r[0] << 8) | gb->cpu.r[1],
             (gb->cpu.r[2] << 8) | gb->cpu.r[3],
             (gb->cpu.r[4] << 8) | gb->cpu.r[5],
@@ -46,17 +57,196 @@ void log_cpu_state_m(gb::gameboy_t* gb) {
 
 
 
-int main() {
+// Each line of the list is a ROM path, optionally followed
+// by a budget in T cycles (60 frames if there's none)
+int run_batch(const char* list, unsigned threads) {
+    std::ifstream file(list);
+
+    if (!file.is_open()) {
+        _log(error, "Couldn't open \"%s\"", list);
+
+        return 1;
+    }
+
+    std::vector<gb::batch_job_t> jobs;
+    std::string line;
+
+    while (std::getline(file, line)) {
+        if (line.empty()) continue;
+
+        gb::batch_job_t job = {};
+
+        job.path = line;
+        job.budget = 60 * FRAME;
+
+        size_t sep = line.find_last_of(" \t");
+
+        if ((sep != std::string::npos) && (line.find_first_not_of("0123456789", sep + 1) == std::string::npos)) {
+            job.path = line.substr(0, sep);
+            job.budget = std::strtoull(line.c_str() + sep + 1, nullptr, 10) * T;
+        }
+
+        jobs.push_back(job);
+    }
+
+    // Per-instruction debug output would serialize every worker on stdout
+    _log::settings::mask = (_log::type_mask_t)(_log::mask_info | _log::mask_warning | _log::mask_error);
+
+    auto start = std::chrono::steady_clock::now();
+
+    gb::batch_run(&jobs, threads);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    int failed = 0;
+
+    for (gb::batch_job_t& job : jobs) {
+        if (!job.loaded) {
+            _log(error, "%s: couldn't load", job.path.c_str());
+
+            failed++;
+
+            continue;
+        }
+
+        _log(info, "%s: PC=%04x, AF=%04x, BC=%04x, DE=%04x, HL=%04x, SP=%04x, CYC=%llu",
+            job.path.c_str(),
+            job.pc,
+            (job.r[7] << 8) | job.r[6],
+            (job.r[0] << 8) | job.r[1],
+            (job.r[2] << 8) | job.r[3],
+            (job.r[4] << 8) | job.r[5],
+            job.sp,
+            (unsigned long long)(job.cycles / T)
+        );
+    }
+
+    _log(info, "Ran %zu ROMs in %.3fs", jobs.size(), elapsed.count());
+
+    return failed ? 1 : 0;
+}
+
+int run_vcd(const char* rom, const char* path, uint64_t cycles) {
+    gb::gameboy_t* gb = new gb::gameboy_t;
+
+    gb::init(gb);
+
+    gb::vcd_t vcd;
+
+    bool ok = gb::insert_cartridge(gb, rom) && gb::vcd_open(&vcd, path);
+
+    if (ok) {
+        for (uint64_t i = 0; i < cycles; i++) {
+            gb::clock(gb);
+            gb::vcd_sample(&vcd, gb);
+        }
+
+        gb::vcd_close(&vcd);
+    }
+
+    gb::destroy(gb);
+
+    delete gb;
+
+    return ok ? 0 : 1;
+}
+
+int run_doctor(const char* rom, const char* log) {
+    gb::gameboy_t* gb = new gb::gameboy_t;
+
+    gb::init(gb);
+
+    bool ok = gb::insert_cartridge(gb, rom);
+
+    if (ok) {
+        auto start = std::chrono::steady_clock::now();
+
+        ok = gb::doctor_compare(gb, log, stdout);
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        _log(info, "Compared in %.3fs", elapsed.count());
+    }
+
+    gb::destroy(gb);
+
+    delete gb;
+
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
     _log::init("gb");
 
+    // gb --batch <list> [threads]
+    if ((argc > 2) && (std::string(argv[1]) == "--batch"))
+        return run_batch(argv[2], (argc > 3) ? std::atoi(argv[3]) : 0);
+
+    // gb --decode <trace> [m|hck] [from T cycle] [records], binary trace to text
+    if ((argc > 2) && (std::string(argv[1]) == "--decode")) {
+        uint8_t mode = ((argc > 3) && (std::string(argv[3]) == "hck")) ? gb::TD_HALF_CYCLE : gb::TD_M_CYCLE;
+        uint64_t from = (argc > 4) ? std::strtoull(argv[4], nullptr, 10) : 0;
+        uint64_t count = (argc > 5) ? std::strtoull(argv[5], nullptr, 10) : UINT64_MAX;
+
+        return gb::trace_decode(argv[2], mode, stdout, from, count) ? 0 : 1;
+    }
+
+    // gb --doctor <rom> <reference log>
+    if ((argc > 3) && (std::string(argv[1]) == "--doctor"))
+        return run_doctor(argv[2], argv[3]);
+
+    // gb --multi-check <rom> [half cycles] [rounds], lock-step engine against run_fast
+    if ((argc > 2) && (std::string(argv[1]) == "--multi-check")) {
+        uint64_t cycles = (argc > 3) ? std::strtoull(argv[3], nullptr, 10) : FRAME;
+        int rounds = (argc > 4) ? std::atoi(argv[4]) : 8;
+
+        return gb::multi_check(argv[2], cycles, rounds, stdout) ? 0 : 1;
+    }
+
+    // gb --vcd <rom> <out.vcd> [half cycles], pin waveforms
+    if ((argc > 3) && (std::string(argv[1]) == "--vcd"))
+        return run_vcd(argv[2], argv[3], (argc > 4) ? std::strtoull(argv[4], nullptr, 10) : FRAME);
+
     gb::gameboy_t gb;
     gb::init(&gb);
 
+    if (argc > 1) {
+        if (!gb::insert_cartridge(&gb, argv[1]))
+            return 1;
+    }
+
+    // gb <rom> <trace>, records a binary trace instead of logging
+    gb::trace_t* trace = nullptr;
+
+    if (argc > 2) {
+        trace = new gb::trace_t;
+
+        if (!gb::trace_open(trace, argv[2])) {
+            delete trace;
+
+            gb::destroy(&gb);
+
+            return 1;
+        }
+    }
+
     //log_cpu_state_m(&gb);
 
     for (int i = 0; i < 9 * M; i++) {
         gb::clock(&gb);
 
-        log_cpu_state_m(&gb);
+        if (trace) {
+            gb::trace_record(trace, &gb);
+        } else {
+            log_cpu_state_m(&gb);
+        }
     }
+
+    if (trace) {
+        gb::trace_close(trace);
+
+        delete trace;
+    }
+
+    gb::destroy(&gb);
 }
\ No newline at end of file